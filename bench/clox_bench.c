@@ -0,0 +1,465 @@
+// end to end benchmark over the scripts in bench/workloads
+//
+// usage:
+//   clox_bench [--runs n] [--dir dir] [--save out.json] [--baseline in.json]
+//              [--threshold percent] [file.lox ...]
+//
+// with no files, every workload in `dir` (bench/workloads) runs, plus a
+// generated source to time the compiler on. each workload runs in a child
+// process of its own, so peak rss is its own too.
+//
+// a sample runs the compiled script `inner` times, `inner` picked so a
+// sample takes about SAMPLE_TIME (the language has no loops yet, so the
+// scripts are short). every number is reported per run: median, p90, p99
+// and min wall time, compile time, bytecode instructions, peak rss, and
+// cycles, cpu instructions, branch and cache misses from perf_event_open
+// (null where perf isn't allowed).
+//
+// the results go to stdout as json, one workload per line. --baseline
+// compares the medians with an earlier --save, and exits with 1 if any
+// workload got slower by more than the threshold.
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clox.h"
+
+#define DEFAULT_RUNS 15
+#define DEFAULT_THRESHOLD 5.0
+#define SAMPLE_TIME 0.002
+#define MAX_INNER (1 << 20)
+#define MAX_WORKLOADS 64
+#define GENERATED_LINES 20000
+
+typedef struct {
+    char name[256];
+    char path[4096]; // empty for the generated source
+} Workload;
+
+typedef enum {
+    MEASURE_COMPILE,
+    MEASURE_RUN,
+} Measure;
+
+typedef struct {
+    CloxVM* vm;
+    const char* source;
+    size_t length;
+    CloxChunk* chunk;
+} Bench;
+
+static const struct {
+    uint64_t config;
+    const char* name;
+} events[] = {
+    {PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_COUNT_HW_INSTRUCTIONS, "cpu_instructions"},
+    {PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"},
+    {PERF_COUNT_HW_CACHE_MISSES, "cache_misses"},
+};
+#define EVENT_COUNT (int)(sizeof(events) / sizeof(events[0]))
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(*size + 1);
+    if (buffer == NULL || fread(buffer, sizeof(char), *size, file) < *size) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    buffer[*size] = '\0';
+
+    fclose(file);
+    return buffer;
+}
+
+// a big script for the compiler, with no constants, as a chunk can't hold
+// more than 256 of them
+static char* generateSource(size_t* size) {
+    static const char* lines[] = {
+        "!(true == !false) == (nil == nil);\n",
+        "        // a comment line that the scanner should skip in one go\n",
+        "print !true == !!false;\n",
+        "((((nil)))) == ((!true));\n",
+    };
+
+    size_t capacity = GENERATED_LINES * 64;
+    char* buffer = (char*)malloc(capacity);
+    size_t length = 0;
+    for (int i = 0; i < GENERATED_LINES; i++)
+        length += snprintf(buffer + length, capacity - length, "%s", lines[i % 4]);
+
+    *size = length;
+    return buffer;
+}
+
+static void discardOutput(void* userdata, const char* chars, size_t length) {
+    (void)userdata;
+    (void)chars;
+    (void)length;
+}
+
+// run or compile once, false on an error
+static bool once(Bench* bench, Measure measure) {
+    if (measure == MEASURE_RUN)
+        return cloxRun(bench->vm, bench->chunk) == CLOX_OK;
+
+    CloxChunk* chunk;
+    if (cloxCompile(bench->vm, bench->source, bench->length, &chunk) != CLOX_OK)
+        return false;
+    cloxFreeChunk(chunk);
+    return true;
+}
+
+static double timeRounds(Bench* bench, Measure measure, int inner) {
+    double start = now();
+    for (int i = 0; i < inner; i++)
+        once(bench, measure);
+    return now() - start;
+}
+
+// how many rounds make a sample of about SAMPLE_TIME
+static int calibrate(Bench* bench, Measure measure) {
+    int inner = 1;
+    while (inner < MAX_INNER && timeRounds(bench, measure, inner) < SAMPLE_TIME)
+        inner *= 2;
+    return inner;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// of sorted samples
+static double percentile(double* samples, int count, double percent) {
+    int index = (int)(percent / 100.0 * (count - 1) + 0.5);
+    return samples[index];
+}
+
+static long perfEventOpen(struct perf_event_attr* attr) {
+    return syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+// -1 for the counters perf doesn't allow
+static void openCounters(int* fds) {
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[i] = (int)perfEventOpen(&attr);
+    }
+}
+
+static void toggleCounters(int* fds, bool enable) {
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        if (fds[i] >= 0)
+            ioctl(fds[i], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+// in the child, writes the workload's json line to `out`
+static void measureWorkload(Workload* workload, int runs, FILE* out) {
+    size_t length;
+    char* source = workload->path[0] == '\0' ? generateSource(&length) : readFile(workload->path, &length);
+    if (source == NULL) {
+        fprintf(out, "{\"name\":\"%s\",\"error\":\"can't read file\"}", workload->name);
+        return;
+    }
+
+    Bench bench = {.vm = cloxNewVM(), .source = source, .length = length, .chunk = NULL};
+    cloxSetOutputCallback(bench.vm, discardOutput, NULL);
+    if (cloxCompile(bench.vm, source, length, &bench.chunk) != CLOX_OK || !once(&bench, MEASURE_RUN)) {
+        fprintf(out, "{\"name\":\"%s\",\"error\":\"script failed\"}", workload->name);
+        return;
+    }
+
+    double* samples = (double*)malloc(sizeof(double) * runs);
+
+    int compileInner = calibrate(&bench, MEASURE_COMPILE);
+    for (int i = 0; i < runs; i++)
+        samples[i] = timeRounds(&bench, MEASURE_COMPILE, compileInner) / compileInner;
+    qsort(samples, runs, sizeof(double), compareDoubles);
+    double compileMedian = percentile(samples, runs, 50);
+
+    // bytecode instructions, counted by a run of the instrumented loop
+    cloxSetOpStats(bench.vm, true);
+    once(&bench, MEASURE_RUN);
+    uint64_t instructions = cloxCountedInstructions(bench.vm);
+    cloxSetOpStats(bench.vm, false);
+
+    int fds[EVENT_COUNT];
+    openCounters(fds);
+    int inner = calibrate(&bench, MEASURE_RUN);
+    toggleCounters(fds, true);
+    for (int i = 0; i < runs; i++)
+        samples[i] = timeRounds(&bench, MEASURE_RUN, inner) / inner;
+    toggleCounters(fds, false);
+    qsort(samples, runs, sizeof(double), compareDoubles);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(out,
+            "{\"name\":\"%s\",\"runs\":%d,\"inner\":%d,\"median_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,"
+            "\"min_ns\":%.1f,\"compile_median_ns\":%.1f,\"instructions\":%llu,\"peak_rss_kb\":%ld",
+            workload->name, runs, inner, percentile(samples, runs, 50) * 1e9, percentile(samples, runs, 90) * 1e9,
+            percentile(samples, runs, 99) * 1e9, samples[0] * 1e9, compileMedian * 1e9,
+            (unsigned long long)instructions, usage.ru_maxrss);
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        uint64_t value;
+        if (fds[i] >= 0 && read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+            fprintf(out, ",\"%s\":%.1f", events[i].name, (double)value / ((double)runs * inner));
+        } else {
+            fprintf(out, ",\"%s\":null", events[i].name);
+        }
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    fprintf(out, "}");
+
+    free(samples);
+    cloxFreeChunk(bench.chunk);
+    cloxFreeVM(bench.vm);
+    free(source);
+}
+
+// the workload's json line, measured in a child process
+static char* runWorkload(Workload* workload, int runs) {
+    int pipes[2];
+    if (pipe(pipes) != 0)
+        return NULL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipes[0]);
+        FILE* out = fdopen(pipes[1], "w");
+        measureWorkload(workload, runs, out);
+        fclose(out);
+        _exit(0);
+    }
+    close(pipes[1]);
+
+    size_t capacity = 4096;
+    size_t length = 0;
+    char* line = (char*)malloc(capacity);
+    ssize_t count;
+    while ((count = read(pipes[0], line + length, capacity - length - 1)) > 0) {
+        length += count;
+        if (length + 1 == capacity) {
+            capacity *= 2;
+            line = (char*)realloc(line, capacity);
+        }
+    }
+    line[length] = '\0';
+    close(pipes[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (length == 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        snprintf(line, capacity, "{\"name\":\"%s\",\"error\":\"crashed\"}", workload->name);
+    }
+    return line;
+}
+
+// named after the file, without directory and .lox
+static void nameWorkload(Workload* workload, const char* path) {
+    const char* base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+    size_t length = strlen(base);
+    if (length > 4 && strcmp(base + length - 4, ".lox") == 0)
+        length -= 4;
+    snprintf(workload->name, sizeof(workload->name), "%.*s", (int)length, base);
+    snprintf(workload->path, sizeof(workload->path), "%s", path);
+}
+
+static int compareWorkloads(const void* a, const void* b) {
+    return strcmp(((const Workload*)a)->name, ((const Workload*)b)->name);
+}
+
+static int listWorkloads(const char* dir, Workload* workloads) {
+    DIR* handle = opendir(dir);
+    if (handle == NULL) {
+        fprintf(stderr, "Could not open directory \"%s\" .\n", dir);
+        exit(74);
+    }
+
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL && count < MAX_WORKLOADS) {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".lox") != 0)
+            continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        nameWorkload(&workloads[count++], path);
+    }
+    closedir(handle);
+
+    qsort(workloads, count, sizeof(Workload), compareWorkloads);
+    return count;
+}
+
+// "key":value in one of our own json lines
+static bool findNumber(const char* line, const char* key, double* value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* found = strstr(line, pattern);
+    return found != NULL && sscanf(found + strlen(pattern), "%lf", value) == 1;
+}
+
+static bool findName(const char* line, char* name, size_t size) {
+    const char* found = strstr(line, "\"name\":\"");
+    if (found == NULL)
+        return false;
+    found += strlen("\"name\":\"");
+    const char* end = strchr(found, '"');
+    if (end == NULL || (size_t)(end - found) >= size)
+        return false;
+    memcpy(name, found, end - found);
+    name[end - found] = '\0';
+    return true;
+}
+
+// the baseline's line for workload `name`, NULL if it has none
+static const char* findBaseline(const char* baseline, const char* name) {
+    char pattern[300];
+    snprintf(pattern, sizeof(pattern), "{\"name\":\"%s\",", name);
+    return strstr(baseline, pattern);
+}
+
+// false if anything got slower than `threshold` percent
+static bool compareBaseline(const char* path, char** lines, int count, double threshold) {
+    size_t size;
+    char* baseline = readFile(path, &size);
+    if (baseline == NULL) {
+        fprintf(stderr, "Could not read baseline \"%s\" .\n", path);
+        exit(74);
+    }
+
+    bool passed = true;
+    fprintf(stderr, "%-20s %14s %14s %9s\n", "workload", "baseline ns", "median ns", "change");
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        double median;
+        double before;
+        if (!findName(lines[i], name, sizeof(name)) || !findNumber(lines[i], "median_ns", &median))
+            continue;
+        const char* old = findBaseline(baseline, name);
+        if (old == NULL || !findNumber(old, "median_ns", &before)) {
+            fprintf(stderr, "%-20s %14s %14.1f %9s\n", name, "-", median, "new");
+            continue;
+        }
+
+        double change = (median - before) / before * 100.0;
+        bool slower = change > threshold;
+        passed = passed && !slower;
+        fprintf(stderr, "%-20s %14.1f %14.1f %+8.1f%%%s\n", name, before, median, change, slower ? "  slower" : "");
+    }
+
+    free(baseline);
+    return passed;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: clox_bench [--runs n] [--dir dir] [--save out.json] [--baseline in.json]\n"
+                    "                  [--threshold percent] [file.lox ...]\n");
+    exit(64);
+}
+
+int main(int argc, const char* argv[]) {
+    int runs = DEFAULT_RUNS;
+    double threshold = DEFAULT_THRESHOLD;
+    const char* dir = "bench/workloads";
+    const char* savePath = NULL;
+    const char* baselinePath = NULL;
+    Workload* workloads = (Workload*)calloc(MAX_WORKLOADS, sizeof(Workload));
+    int count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = (int)strtol(argv[++i], NULL, 10);
+            if (runs <= 0)
+                usage();
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], NULL);
+        } else if (argv[i][0] != '-' && count < MAX_WORKLOADS) {
+            nameWorkload(&workloads[count++], argv[i]);
+        } else {
+            usage();
+        }
+    }
+
+    if (count == 0) {
+        count = listWorkloads(dir, workloads);
+        if (count < MAX_WORKLOADS)
+            snprintf(workloads[count++].name, sizeof(workloads[0].name), "generated_compile");
+    }
+
+    char** lines = (char**)calloc(count, sizeof(char*));
+    bool failed = false;
+    for (int i = 0; i < count; i++) {
+        fprintf(stderr, "running %s\n", workloads[i].name);
+        lines[i] = runWorkload(&workloads[i], runs);
+        failed = failed || lines[i] == NULL || strstr(lines[i], "\"error\"") != NULL;
+    }
+
+    FILE* save = savePath != NULL ? fopen(savePath, "w") : NULL;
+    if (savePath != NULL && save == NULL) {
+        fprintf(stderr, "Could not write \"%s\" .\n", savePath);
+        exit(74);
+    }
+    FILE* outs[] = {stdout, save};
+    for (int out = 0; out < 2; out++) {
+        if (outs[out] == NULL)
+            continue;
+        fprintf(outs[out], "{\"workloads\":[\n");
+        for (int i = 0; i < count; i++)
+            fprintf(outs[out], "%s%s\n", lines[i] != NULL ? lines[i] : "{}", i + 1 < count ? "," : "");
+        fprintf(outs[out], "]}\n");
+    }
+    if (save != NULL)
+        fclose(save);
+
+    if (baselinePath != NULL && !compareBaseline(baselinePath, lines, count, threshold))
+        failed = true;
+
+    for (int i = 0; i < count; i++)
+        free(lines[i]);
+    free(lines);
+    free(workloads);
+    return failed ? 1 : 0;
+}
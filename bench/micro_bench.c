@@ -0,0 +1,329 @@
+// component microbenchmarks: the hash table, scanner, compiler, string
+// interning and the allocator, each on its own, straight on the internals
+// instead of through a script
+//
+// usage:
+//   micro_bench [name-prefix]
+//
+// every result is one json line on stdout,
+//   {"bench":"table_get_hit","param":"capacity=1024,load=0.50","ops":..,"ns_per_op":..}
+// the best of ROUNDS rounds, so a change to table.c, scanner.c or memory.c
+// can be compared before and after without the noise of a full run.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "memory.h"
+#include "object.h"
+#include "scanner.h"
+#include "table.h"
+#include "vm.h"
+
+#define ROUNDS 5
+#define TABLE_OPS 1000000
+#define STRING_OPS 200000
+#define ALLOCATION_OPS 1000000
+#define SOURCE_LINES 20000
+
+static const char* filter = NULL;
+static VM vm;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool selected(const char* name) {
+    return filter == NULL || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+static void report(const char* name, const char* param, long ops, double seconds) {
+    printf("{\"bench\":\"%s\",\"param\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.2f}\n", name, param, ops,
+           seconds * 1e9 / ops);
+    fflush(stdout);
+}
+
+// keeps results alive, so the compiler can't drop the work
+static volatile long sink;
+
+// `count` distinct strings interned in `vm`, "<prefix><n>"
+static ObjString** makeKeys(const char* prefix, int count) {
+    ObjString** keys = ALLOCATE(ObjString*, count);
+    char buffer[64];
+    for (int i = 0; i < count; i++) {
+        int length = snprintf(buffer, sizeof(buffer), "%s%d", prefix, i);
+        keys[i] = copyString(&vm, buffer, length);
+    }
+    return keys;
+}
+
+// get/set/delete/findString on a table with `capacity` slots, `load` full
+static void benchTable(int capacity, double load) {
+    int count = (int)(capacity * load);
+    char param[64];
+    snprintf(param, sizeof(param), "capacity=%d,load=%.2f", capacity, load);
+
+    ObjString** keys = makeKeys("key_", count);
+    ObjString** misses = makeKeys("miss_", count);
+    Table table;
+    initTable(&table);
+    for (int i = 0; i < count; i++)
+        tableSet(&table, keys[i], NUMBER_VAL(i));
+
+    double best[5] = {1e9, 1e9, 1e9, 1e9, 1e9};
+    for (int round = 0; round < ROUNDS; round++) {
+        Value value;
+        long found = 0;
+        double start = now();
+        for (int i = 0; i < TABLE_OPS; i++)
+            found += tableGet(&table, keys[i % count], &value);
+        double elapsed = now() - start;
+        best[0] = elapsed < best[0] ? elapsed : best[0];
+
+        start = now();
+        for (int i = 0; i < TABLE_OPS; i++)
+            found += tableGet(&table, misses[i % count], &value);
+        elapsed = now() - start;
+        best[1] = elapsed < best[1] ? elapsed : best[1];
+
+        // overwrites, the table doesn't grow
+        start = now();
+        for (int i = 0; i < TABLE_OPS; i++)
+            found += tableSet(&table, keys[i % count], BOOL_VAL(true));
+        elapsed = now() - start;
+        best[2] = elapsed < best[2] ? elapsed : best[2];
+
+        // delete and put back, leaves the load as it was
+        start = now();
+        for (int i = 0; i < TABLE_OPS / 2; i++) {
+            found += tableDelete(&table, keys[i % count]);
+            found += tableSet(&table, keys[i % count], NIL_VAL);
+        }
+        elapsed = now() - start;
+        best[3] = elapsed < best[3] ? elapsed : best[3];
+
+        start = now();
+        for (int i = 0; i < TABLE_OPS; i++) {
+            ObjString* key = keys[i % count];
+            found += tableFindString(&table, key->chars, key->length, key->hash) != NULL;
+        }
+        elapsed = now() - start;
+        best[4] = elapsed < best[4] ? elapsed : best[4];
+        sink = found;
+    }
+
+    if (table.capacity != capacity)
+        snprintf(param, sizeof(param), "capacity=%d,load=%.2f", table.capacity, (double)table.count / table.capacity);
+    report("table_get_hit", param, TABLE_OPS, best[0]);
+    report("table_get_miss", param, TABLE_OPS, best[1]);
+    report("table_set_existing", param, TABLE_OPS, best[2]);
+    report("table_delete_set", param, TABLE_OPS, best[3]);
+    report("table_find_string", param, TABLE_OPS, best[4]);
+
+    freeTable(&table);
+    FREE_ARRAY(ObjString*, keys, count);
+    FREE_ARRAY(ObjString*, misses, count);
+}
+
+// constant free, as a chunk can't hold more than 256 constants
+static char* generateSource(size_t* size) {
+    static const char* lines[] = {
+        "!(true == !false) == (nil == nil);\n",
+        "        // a comment line that the scanner should skip in one go\n",
+        "print !true == !!false;\n",
+        "((((nil)))) == ((!true));\n",
+    };
+
+    size_t capacity = SOURCE_LINES * 64;
+    char* buffer = ALLOCATE(char, capacity);
+    size_t length = 0;
+    for (int i = 0; i < SOURCE_LINES; i++)
+        length += snprintf(buffer + length, capacity - length, "%s", lines[i % 4]);
+
+    *size = length;
+    return buffer;
+}
+
+static void benchScanner(const char* source, size_t size) {
+    double best = 1e9;
+    long tokens = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        Scanner scanner;
+        initScanner(&scanner, source, size);
+        long count = 0;
+        double start = now();
+        while (scanToken(&scanner).type != TOKEN_EOF)
+            count++;
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+        tokens = count;
+    }
+
+    char param[64];
+    snprintf(param, sizeof(param), "bytes=%zu", size);
+    report("scan_token", param, tokens, best);
+}
+
+// reported per KB of source
+static void benchCompiler(const char* source, size_t size) {
+    double best = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        Chunk chunk;
+        initChunk(&chunk);
+        double start = now();
+        bool compiled = compile(&vm, source, size, &chunk);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+        sink = compiled;
+        freeChunk(&chunk);
+    }
+
+    char param[64];
+    snprintf(param, sizeof(param), "bytes=%zu", size);
+    report("compile_per_kb", param, (long)(size / 1024), best);
+}
+
+static void benchStrings() {
+    char (*texts)[32] = malloc(sizeof(*texts) * STRING_OPS);
+    int* lengths = malloc(sizeof(int) * STRING_OPS);
+    for (int i = 0; i < STRING_OPS; i++)
+        lengths[i] = snprintf(texts[i], sizeof(texts[i]), "string_number_%d", i);
+
+    // a fresh vm every round, it keeps every string it interned
+    double best[4] = {1e9, 1e9, 1e9, 1e9};
+    for (int round = 0; round < ROUNDS; round++) {
+        VM strings;
+        initVM(&strings);
+
+        // new strings, each one copied, hashed and interned
+        double start = now();
+        for (int i = 0; i < STRING_OPS; i++)
+            sink = (long)copyString(&strings, texts[i], lengths[i]);
+        double elapsed = now() - start;
+        best[0] = elapsed < best[0] ? elapsed : best[0];
+
+        // the same again, all found interned
+        start = now();
+        for (int i = 0; i < STRING_OPS; i++)
+            sink = (long)copyString(&strings, texts[i], lengths[i]);
+        elapsed = now() - start;
+        best[1] = elapsed < best[1] ? elapsed : best[1];
+
+        // takeString() on an interned string frees the chars it was given
+        start = now();
+        for (int i = 0; i < STRING_OPS; i++) {
+            char* chars = ALLOCATE(char, lengths[i] + 1);
+            memcpy(chars, texts[i], lengths[i] + 1);
+            sink = (long)takeString(&strings, chars, lengths[i]);
+        }
+        elapsed = now() - start;
+        best[2] = elapsed < best[2] ? elapsed : best[2];
+
+        start = now();
+        for (int i = 0; i < STRING_OPS; i++) {
+            char* chars = ALLOCATE(char, lengths[i] + 1);
+            memcpy(chars, texts[i], lengths[i] + 1);
+            chars[0] = 'S';
+            sink = (long)takeString(&strings, chars, lengths[i]);
+        }
+        elapsed = now() - start;
+        best[3] = elapsed < best[3] ? elapsed : best[3];
+
+        freeVM(&strings);
+    }
+
+    report("copy_string_new", "length<=32", STRING_OPS, best[0]);
+    report("copy_string_interned", "length<=32", STRING_OPS, best[1]);
+    report("take_string_interned", "length<=32", STRING_OPS, best[2]);
+    report("take_string_new", "length<=32", STRING_OPS, best[3]);
+    free(texts);
+    free(lengths);
+}
+
+static void benchAllocator() {
+    static const size_t sizes[] = {16, 64, 256, 4096};
+    for (int s = 0; s < 4; s++) {
+        double best = 1e9;
+        for (int round = 0; round < ROUNDS; round++) {
+            double start = now();
+            for (int i = 0; i < ALLOCATION_OPS; i++) {
+                char* bytes = ALLOCATE(char, sizes[s]);
+                bytes[0] = (char)i;
+                sink = bytes[0];
+                FREE_ARRAY(char, bytes, sizes[s]);
+            }
+            double elapsed = now() - start;
+            best = elapsed < best ? elapsed : best;
+        }
+        char param[64];
+        snprintf(param, sizeof(param), "bytes=%zu", sizes[s]);
+        report("reallocate_alloc_free", param, ALLOCATION_OPS, best);
+    }
+
+    // an array grown the way chunks and value arrays grow, 8 to 64k slots
+    double best = 1e9;
+    int arrays = ALLOCATION_OPS / 1000;
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now();
+        for (int i = 0; i < arrays; i++) {
+            int capacity = 0;
+            int* array = NULL;
+            while (capacity < 65536) {
+                int oldCapacity = capacity;
+                capacity = GROW_CAPACITY(oldCapacity);
+                array = GROW_ARRAY(int, array, oldCapacity, capacity);
+                array[capacity - 1] = i;
+            }
+            sink = array[capacity - 1];
+            FREE_ARRAY(int, array, capacity);
+        }
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    report("reallocate_grow_array", "slots=65536", arrays, best);
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: micro_bench [name-prefix]\n");
+        exit(64);
+    }
+    if (argc == 2)
+        filter = argv[1];
+
+    if (!initVM(&vm)) {
+        fprintf(stderr, "Could not reserve the value stack.\n");
+        exit(1);
+    }
+
+    if (selected("table")) {
+        static const int capacities[] = {1024, 262144};
+        // a table grows past 0.75, and a set checks that before it looks
+        // for the key, so 0.74 is as full as one gets
+        static const double loads[] = {0.40, 0.50, 0.60, 0.70, 0.74};
+        for (int c = 0; c < 2; c++) {
+            for (int l = 0; l < 5; l++)
+                benchTable(capacities[c], loads[l]);
+        }
+    }
+
+    size_t size;
+    char* source = generateSource(&size);
+    if (selected("scan"))
+        benchScanner(source, size);
+    if (selected("compile"))
+        benchCompiler(source, size);
+    FREE_ARRAY(char, source, SOURCE_LINES * 64);
+
+    if (selected("copy") || selected("take"))
+        benchStrings();
+    if (selected("reallocate"))
+        benchAllocator();
+
+    freeVM(&vm);
+    return 0;
+}
@@ -0,0 +1,112 @@
+// scanner throughput benchmark
+//
+// usage:
+//   scanner_bench [file.lox ...]
+//
+// scans every file (or a generated source when none is given) until
+// TOKEN_EOF, several rounds each, and reports tokens per second.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scanner.h"
+
+#define ROUNDS 10
+#define GENERATED_LINES 200000
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" .\n", path);
+        exit(74);
+    }
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(*size + 1);
+    if (buffer == NULL || fread(buffer, sizeof(char), *size, file) < *size) {
+        fprintf(stderr, "Could not read file \"%s\" .\n", path);
+        exit(74);
+    }
+    buffer[*size] = '\0';
+
+    fclose(file);
+    return buffer;
+}
+
+// looks like the generated scripts we load: long identifiers, deep
+// indentation, comments and string tables
+static char* generateSource(size_t* size) {
+    // split around the two numbers, so the format stays a literal
+    static const char* lines[][3] = {
+        {"var generated_identifier_number_", " = ", ".25 * (another_long_identifier + 1);\n"},
+        {"        // a comment line that the scanner should skip in one go ", " ", "\n"},
+        {"print \"a fairly long string literal used in tables, row ", " col ", "\";\n"},
+        {"                other_variable_name_", " = other_variable_name_", " - 42;\n"},
+    };
+
+    size_t capacity = GENERATED_LINES * 96;
+    char* buffer = (char*)malloc(capacity);
+    size_t length = 0;
+    for (int i = 0; i < GENERATED_LINES; i++) {
+        const char** line = lines[i % 4];
+        length += snprintf(buffer + length, capacity - length, "%s%d%s%d%s", line[0], i, line[1], i, line[2]);
+    }
+
+    *size = length;
+    return buffer;
+}
+
+static void bench(const char* name, const char* source, size_t size) {
+    long tokens = 0;
+    double best = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        long count = 0;
+        double start = now();
+
+        Scanner scanner;
+        initScanner(&scanner, source, size);
+        while (true) {
+            Token token = scanToken(&scanner);
+            count++;
+            if (token.type == TOKEN_EOF)
+                break;
+        }
+
+        double elapsed = now() - start;
+        if (round == 0 || elapsed < best)
+            best = elapsed;
+        tokens = count;
+    }
+
+    printf("%-32s %10zu bytes %10ld tokens %8.2f Mtokens/s %8.2f MB/s\n", name, size, tokens, tokens / best / 1e6,
+           size / best / 1e6);
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc == 1) {
+        size_t size;
+        char* source = generateSource(&size);
+        bench("<generated>", source, size);
+        free(source);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        size_t size;
+        char* source = readFile(argv[i], &size);
+        bench(argv[i], source, size);
+        free(source);
+    }
+    return 0;
+}
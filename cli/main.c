@@ -0,0 +1,247 @@
+// the clox command line, a plain libclox host, see include/clox.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "clox.h"
+#include "serve.h"
+
+static CloxVM* vm;
+// --opstats and --allocstats, report to stderr once the script is done
+static bool opstats = false;
+static bool opstatsJson = false;
+static bool allocstats = false;
+// --profile, folded stacks go to this file
+static const char* profileOutput = NULL;
+
+static void writeReports() {
+    if (opstats)
+        cloxWriteOpStats(vm, STDERR_FILENO, opstatsJson);
+    if (allocstats)
+        cloxWriteAllocStats(vm, STDERR_FILENO);
+
+    if (profileOutput == NULL)
+        return;
+    cloxStopProfile();
+    int fd = open(profileOutput, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !cloxWriteProfile(fd))
+        fprintf(stderr, "Could not write profile \"%s\" .\n", profileOutput);
+    if (fd >= 0)
+        close(fd);
+}
+
+static void repl() {
+    char line[1024];
+
+    while (true) {
+        printf("> ");
+
+        if (!fgets(line, sizeof(line), stdin)) {
+            printf("\n");
+            break;
+        }
+
+        cloxInterpret(vm, line, strlen(line));
+        cloxFlush(vm);
+    }
+    writeReports();
+}
+
+static void runFile(const char* path) {
+    // .loxc images are told apart by their magic, not the extension
+    bool image = cloxIsImage(path);
+    CloxResult result = cloxRunFile(vm, path);
+    // exit() below skips cloxFreeVM()
+    cloxFlush(vm);
+    writeReports();
+
+    if (result == CLOX_IO_ERROR && image)
+        exit(74);
+    if (result == CLOX_IO_ERROR) {
+        fprintf(stderr, "Could not read file \"%s\" .\n", path);
+        exit(74);
+    }
+    if (result == CLOX_COMPILE_ERROR)
+        exit(65);
+    if (result == CLOX_RUNTIME_ERROR)
+        exit(70);
+}
+
+// clox --compile in.lox -o out.loxc
+static void compileFile(const char* path, const char* output) {
+    CloxChunk* chunk;
+    CloxResult result = cloxCompileFile(vm, path, &chunk);
+    if (result == CLOX_IO_ERROR) {
+        fprintf(stderr, "Could not read file \"%s\" .\n", path);
+        exit(74);
+    }
+    if (result != CLOX_OK)
+        exit(65);
+
+    if (!cloxSaveImage(chunk, output)) {
+        fprintf(stderr, "Could not write image \"%s\" .\n", output);
+        exit(74);
+    }
+    cloxFreeChunk(chunk);
+}
+
+// clox --emit-c in.lox -o out.c
+static void emitFile(const char* path, const char* output) {
+    CloxChunk* chunk;
+    CloxResult result = cloxCompileFile(vm, path, &chunk);
+    if (result == CLOX_IO_ERROR) {
+        fprintf(stderr, "Could not read file \"%s\" .\n", path);
+        exit(74);
+    }
+    if (result != CLOX_OK)
+        exit(65);
+
+    if (!cloxEmitC(chunk, path, output)) {
+        fprintf(stderr, "Could not write c \"%s\" .\n", output);
+        exit(74);
+    }
+    cloxFreeChunk(chunk);
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: clox [--pretokenize] [--trace] [--disasm] [--opstats[=text|json]] [--allocstats]\n"
+                    "            [--profile out.folded] [--jit[=runs]] [--output-buffer bytes] [--cache-dir dir]\n"
+                    "            [path]\n"
+                    "       clox --compile in.lox -o out.loxc\n"
+                    "       clox --emit-c in.lox -o out.c\n"
+                    "       clox --snapshot out.loxs prelude.lox\n"
+                    "       clox --restore in.loxs [path]\n"
+                    "       clox --serve path.sock [--workers n] [--restore in.loxs] [--prelude file.lox] [--log]\n"
+                    "            [--jit[=runs]]\n"
+                    "       clox --send path.sock script.lox\n"
+                    "       clox --metrics path.sock\n");
+    exit(64);
+}
+
+int main(int argc, const char* argv[]) {
+    vm = cloxNewVM();
+    if (vm == NULL) {
+        fprintf(stderr, "Could not reserve the value stack.\n");
+        exit(1);
+    }
+
+    const char* path = NULL;
+    const char* compileOutput = NULL;
+    const char* sendTo = NULL;
+    const char* metricsOf = NULL;
+    const char* snapshotOutput = NULL;
+    bool compileOnly = false;
+    bool emitOnly = false;
+    ServeOptions serveOptions = {.workers = (int)sysconf(_SC_NPROCESSORS_ONLN)};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compile") == 0) {
+            compileOnly = true;
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            emitOnly = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            compileOutput = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            serveOptions.cacheDir = argv[++i];
+            cloxSetCacheDir(vm, serveOptions.cacheDir);
+        } else if (strcmp(argv[i], "--pretokenize") == 0) {
+            cloxSetPretokenize(vm, true);
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            cloxSetTrace(vm, true);
+        } else if (strcmp(argv[i], "--disasm") == 0) {
+            cloxSetDisasm(vm, true);
+        } else if (strcmp(argv[i], "--opstats") == 0 || strcmp(argv[i], "--opstats=text") == 0 ||
+                   strcmp(argv[i], "--opstats=json") == 0) {
+            opstats = true;
+            opstatsJson = strcmp(argv[i], "--opstats=json") == 0;
+            cloxSetOpStats(vm, true);
+        } else if (strcmp(argv[i], "--allocstats") == 0) {
+            allocstats = true;
+            cloxSetAllocStats(vm, true);
+        } else if (strcmp(argv[i], "--jit") == 0 || strncmp(argv[i], "--jit=", 6) == 0) {
+            // --jit compiles every chunk, --jit=n the ones run n times
+            serveOptions.jit = argv[i][5] == '=' ? (int)strtol(argv[i] + 6, NULL, 10) : 1;
+            if (serveOptions.jit <= 0)
+                usage();
+            cloxSetJit(vm, serveOptions.jit);
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profileOutput = argv[++i];
+        } else if (strcmp(argv[i], "--output-buffer") == 0 && i + 1 < argc) {
+            long size = strtol(argv[++i], NULL, 10);
+            if (size <= 0)
+                usage();
+            cloxSetOutputBuffer(vm, (size_t)size);
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveOptions.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            serveOptions.workers = (int)strtol(argv[++i], NULL, 10);
+            if (serveOptions.workers <= 0)
+                usage();
+        } else if (strcmp(argv[i], "--prelude") == 0 && i + 1 < argc) {
+            serveOptions.prelude = argv[++i];
+        } else if (strcmp(argv[i], "--log") == 0) {
+            serveOptions.log = true;
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshotOutput = argv[++i];
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            serveOptions.snapshot = argv[++i];
+        } else if (strcmp(argv[i], "--send") == 0 && i + 1 < argc) {
+            sendTo = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsOf = argv[++i];
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    // the client modes don't need the local vm
+    if (sendTo != NULL || metricsOf != NULL || serveOptions.socketPath != NULL)
+        cloxFreeVM(vm);
+    if (sendTo != NULL) {
+        if (path == NULL)
+            usage();
+        return sendScript(sendTo, path);
+    }
+    if (metricsOf != NULL)
+        return sendMetricsRequest(metricsOf);
+    if (serveOptions.socketPath != NULL)
+        return serve(&serveOptions);
+
+    // samples are taken from here on, compiling included
+    if (profileOutput != NULL && !cloxStartProfile(0)) {
+        fprintf(stderr, "Could not start the profiler.\n");
+        exit(1);
+    }
+
+    // start from a saved heap instead of an empty one
+    if (serveOptions.snapshot != NULL && !cloxRestoreSnapshot(vm, serveOptions.snapshot))
+        exit(74);
+
+    if (snapshotOutput != NULL) {
+        // run the prelude, then save what it left behind
+        if (path != NULL)
+            runFile(path);
+        if (!cloxSaveSnapshot(vm, snapshotOutput)) {
+            fprintf(stderr, "Could not write snapshot \"%s\" .\n", snapshotOutput);
+            exit(74);
+        }
+    } else if (compileOnly) {
+        if (path == NULL || compileOutput == NULL)
+            usage();
+        compileFile(path, compileOutput);
+    } else if (emitOnly) {
+        if (path == NULL || compileOutput == NULL)
+            usage();
+        emitFile(path, compileOutput);
+    } else if (path == NULL) {
+        repl();
+    } else {
+        runFile(path);
+    }
+
+    cloxFreeVM(vm);
+    return 0;
+}
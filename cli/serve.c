@@ -0,0 +1,472 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clox.h"
+#include "serve.h"
+
+#define FRAME_HEADER_SIZE 5
+
+// accepted connections waiting for a worker, plus the metrics. everything
+// here is guarded by `lock`
+typedef struct {
+    int fds[SERVE_QUEUE_SIZE];
+    uint64_t enqueuedAt[SERVE_QUEUE_SIZE];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+
+    int workers;
+    bool log;
+    uint64_t requests;
+    uint64_t failures;
+    int maxDepth;
+    uint64_t waitNs;
+    uint64_t maxWaitNs;
+    uint64_t runNs;
+    uint64_t maxRunNs;
+} Server;
+
+typedef struct {
+    Server* server;
+    CloxVM* vm;
+    pthread_t thread;
+} Worker;
+
+static uint64_t now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+static bool sendAll(int fd, const void* bytes, size_t length) {
+    const char* chars = (const char*)bytes;
+    while (length > 0) {
+        // MSG_NOSIGNAL, a client hanging up must not kill the server
+        ssize_t sent = send(fd, chars, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        chars += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* bytes, size_t length) {
+    char* chars = (char*)bytes;
+    while (length > 0) {
+        ssize_t got = read(fd, chars, length);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        chars += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+static bool sendFrame(int fd, char type, const void* payload, uint32_t length) {
+    uint8_t header[FRAME_HEADER_SIZE] = {(uint8_t)type, length & 0xff, (length >> 8) & 0xff, (length >> 16) & 0xff,
+                                         (length >> 24) & 0xff};
+    return sendAll(fd, header, sizeof(header)) && sendAll(fd, payload, length);
+}
+
+static bool readFrame(int fd, char* type, uint32_t* length) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    if (!readAll(fd, header, sizeof(header)))
+        return false;
+    *type = (char)header[0];
+    *length = header[1] | (header[2] << 8) | (header[3] << 16) | ((uint32_t)header[4] << 24);
+    return true;
+}
+
+static bool sendStatus(int fd, CloxResult result, uint64_t runNs) {
+    uint8_t status[9];
+    status[0] = (uint8_t)result;
+    for (int i = 0; i < 8; i++)
+        status[1 + i] = (runNs >> (8 * i)) & 0xff;
+    return sendFrame(fd, FRAME_STATUS, status, sizeof(status));
+}
+
+static void enqueue(Server* server, int fd) {
+    pthread_mutex_lock(&server->lock);
+    while (server->count == SERVE_QUEUE_SIZE)
+        pthread_cond_wait(&server->notFull, &server->lock);
+
+    int tail = (server->head + server->count) % SERVE_QUEUE_SIZE;
+    server->fds[tail] = fd;
+    server->enqueuedAt[tail] = now();
+    server->count++;
+    if (server->count > server->maxDepth)
+        server->maxDepth = server->count;
+
+    pthread_cond_signal(&server->notEmpty);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static int dequeue(Server* server, uint64_t* enqueuedAt) {
+    pthread_mutex_lock(&server->lock);
+    while (server->count == 0)
+        pthread_cond_wait(&server->notEmpty, &server->lock);
+
+    int fd = server->fds[server->head];
+    *enqueuedAt = server->enqueuedAt[server->head];
+    server->head = (server->head + 1) % SERVE_QUEUE_SIZE;
+    server->count--;
+
+    pthread_cond_signal(&server->notFull);
+    pthread_mutex_unlock(&server->lock);
+    return fd;
+}
+
+static void record(Server* server, CloxResult result, uint64_t waitNs, uint64_t runNs) {
+    pthread_mutex_lock(&server->lock);
+    server->requests++;
+    if (result != CLOX_OK)
+        server->failures++;
+    server->waitNs += waitNs;
+    server->runNs += runNs;
+    if (waitNs > server->maxWaitNs)
+        server->maxWaitNs = waitNs;
+    if (runNs > server->maxRunNs)
+        server->maxRunNs = runNs;
+    int depth = server->count;
+    pthread_mutex_unlock(&server->lock);
+
+    if (server->log)
+        fprintf(stderr, "serve: result %d queued %.3fms ran %.3fms depth %d\n", result, waitNs / 1e6, runNs / 1e6,
+                depth);
+}
+
+static void sendMetrics(Server* server, int fd) {
+    char text[512];
+    pthread_mutex_lock(&server->lock);
+    int length = snprintf(text, sizeof(text),
+                          "workers %d\n"
+                          "requests %llu\n"
+                          "failures %llu\n"
+                          "queue_depth %d\n"
+                          "queue_depth_max %d\n"
+                          "wait_ns_total %llu\n"
+                          "wait_ns_max %llu\n"
+                          "run_ns_total %llu\n"
+                          "run_ns_max %llu\n",
+                          server->workers, (unsigned long long)server->requests,
+                          (unsigned long long)server->failures, server->count, server->maxDepth,
+                          (unsigned long long)server->waitNs, (unsigned long long)server->maxWaitNs,
+                          (unsigned long long)server->runNs, (unsigned long long)server->maxRunNs);
+    pthread_mutex_unlock(&server->lock);
+
+    sendFrame(fd, FRAME_OUTPUT, text, (uint32_t)length);
+    sendStatus(fd, CLOX_OK, 0);
+}
+
+// the vm's output callback, every flushed block becomes an output frame
+static void writeToClient(void* userdata, const char* chars, size_t length) {
+    int fd = *(int*)userdata;
+    sendFrame(fd, FRAME_OUTPUT, chars, (uint32_t)length);
+}
+
+static void handle(Worker* worker, int fd, uint64_t waitNs) {
+    char type;
+    uint32_t length;
+    if (!readFrame(fd, &type, &length))
+        return;
+
+    if (type == FRAME_METRICS) {
+        sendMetrics(worker->server, fd);
+        return;
+    }
+    if (type != FRAME_SCRIPT || length > SERVE_MAX_SCRIPT) {
+        sendStatus(fd, CLOX_IO_ERROR, 0);
+        return;
+    }
+
+    char* source = (char*)malloc(length > 0 ? length : 1);
+    if (source == NULL || !readAll(fd, source, length)) {
+        free(source);
+        sendStatus(fd, CLOX_IO_ERROR, 0);
+        return;
+    }
+
+    uint64_t started = now();
+    cloxSetOutputCallback(worker->vm, writeToClient, &fd);
+    CloxResult result = cloxInterpret(worker->vm, source, length);
+    cloxFlush(worker->vm);
+    // back to the warm state for the next request
+    cloxResetGlobals(worker->vm);
+    uint64_t runNs = now() - started;
+    free(source);
+
+    sendStatus(fd, result, runNs);
+    record(worker->server, result, waitNs, runNs);
+}
+
+// reads and sends on the connection fail once the client stalls, handle()
+// then just gives up on it
+static bool setTimeouts(int fd) {
+    struct timeval timeout = {.tv_sec = SERVE_TIMEOUT_SECONDS, .tv_usec = 0};
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+           setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+static void* work(void* arg) {
+    Worker* worker = (Worker*)arg;
+    for (;;) {
+        uint64_t enqueuedAt;
+        int fd = dequeue(worker->server, &enqueuedAt);
+        if (setTimeouts(fd))
+            handle(worker, fd, now() - enqueuedAt);
+        close(fd);
+    }
+    return NULL;
+}
+
+static CloxVM* warmVM(const ServeOptions* options) {
+    CloxVM* vm = cloxNewVM();
+    if (vm == NULL)
+        return NULL;
+
+    // repeated scripts skip the compiler
+    cloxSetCacheDir(vm, options->cacheDir);
+    // and hot ones run as machine code
+    cloxSetJit(vm, options->jit);
+    if (options->snapshot != NULL && !cloxRestoreSnapshot(vm, options->snapshot)) {
+        cloxFreeVM(vm);
+        return NULL;
+    }
+    if (options->prelude != NULL) {
+        CloxResult result = cloxRunFile(vm, options->prelude);
+        cloxFlush(vm);
+        if (result != CLOX_OK) {
+            fprintf(stderr, "Could not run prelude \"%s\" .\n", options->prelude);
+            cloxFreeVM(vm);
+            return NULL;
+        }
+    }
+    cloxMarkGlobals(vm);
+    return vm;
+}
+
+static int listenOn(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path \"%s\" is too long.\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    // a socket file left over from an earlier run goes, anything else at
+    // the path is not ours to delete
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "Could not listen on \"%s\", it exists and is not a socket.\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "Could not listen on \"%s\" .\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// undo what serve() set up when it can't start after all
+static int stopServing(int listener, const ServeOptions* options, Worker* workers, int code) {
+    if (workers != NULL) {
+        for (int i = 0; i < options->workers; i++) {
+            if (workers[i].vm != NULL)
+                cloxFreeVM(workers[i].vm);
+        }
+        free(workers);
+    }
+    close(listener);
+    unlink(options->socketPath);
+    return code;
+}
+
+int serve(const ServeOptions* options) {
+    int listener = listenOn(options->socketPath);
+    if (listener < 0)
+        return 74;
+
+    static Server server;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.notEmpty, NULL);
+    pthread_cond_init(&server.notFull, NULL);
+    server.workers = options->workers;
+    server.log = options->log;
+
+    // a seed vm warmed the same way gives its strings to the shared set,
+    // the workers then only intern what the requests bring
+    if (options->prelude != NULL || options->snapshot != NULL) {
+        CloxVM* seed = warmVM(options);
+        if (seed == NULL)
+            return stopServing(listener, options, NULL, 70);
+        cloxShareStrings(seed);
+        cloxFreeVM(seed);
+    }
+
+    // all vms are warm before the first request is taken
+    Worker* workers = (Worker*)calloc(options->workers, sizeof(Worker));
+    if (workers == NULL) {
+        fprintf(stderr, "Could not allocate %d workers.\n", options->workers);
+        return stopServing(listener, options, NULL, 70);
+    }
+    for (int i = 0; i < options->workers; i++) {
+        workers[i].server = &server;
+        workers[i].vm = warmVM(options);
+        if (workers[i].vm == NULL)
+            return stopServing(listener, options, workers, 70);
+    }
+    // the threads already running only wait on the empty queue, so their
+    // vms can go as well
+    for (int i = 0; i < options->workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker %d.\n", i);
+            return stopServing(listener, options, workers, 70);
+        }
+    }
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "Could not accept on \"%s\" .\n", options->socketPath);
+            return 74;
+        }
+        enqueue(&server, fd);
+    }
+}
+
+static int connectTo(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+        return fd;
+
+    fprintf(stderr, "Could not connect to \"%s\" .\n", path);
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+// print output frames until the status arrives, exit code from the status
+static int readResponse(int fd) {
+    char type;
+    uint32_t length;
+    while (readFrame(fd, &type, &length)) {
+        char* payload = (char*)malloc(length > 0 ? length : 1);
+        if (payload == NULL || !readAll(fd, payload, length)) {
+            free(payload);
+            break;
+        }
+
+        if (type == FRAME_OUTPUT) {
+            fwrite(payload, 1, length, stdout);
+            free(payload);
+            continue;
+        }
+
+        CloxResult result = type == FRAME_STATUS && length > 0 ? (CloxResult)payload[0] : CLOX_IO_ERROR;
+        free(payload);
+        fflush(stdout);
+        switch (result) {
+            case CLOX_OK:
+                return 0;
+            case CLOX_COMPILE_ERROR:
+                return 65;
+            case CLOX_RUNTIME_ERROR:
+                return 70;
+            case CLOX_IO_ERROR:
+            case CLOX_YIELD:
+                return 74;
+        }
+    }
+    fprintf(stderr, "Connection closed before the script finished.\n");
+    return 74;
+}
+
+int sendScript(const char* socketPath, const char* scriptPath) {
+    FILE* file = fopen(scriptPath, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not read file \"%s\" .\n", scriptPath);
+        return 74;
+    }
+
+    // read up to eof, a pipe has no size to ask for up front
+    size_t capacity = 4096;
+    size_t length = 0;
+    char* source = (char*)malloc(capacity);
+    while (source != NULL) {
+        length += fread(source + length, 1, capacity - length, file);
+        if (length < capacity || capacity > SERVE_MAX_SCRIPT)
+            break;
+        capacity *= 2;
+        char* grown = (char*)realloc(source, capacity);
+        if (grown == NULL)
+            free(source);
+        source = grown;
+    }
+    bool failed = source == NULL || ferror(file);
+    fclose(file);
+    if (failed) {
+        free(source);
+        fprintf(stderr, "Could not read file \"%s\" .\n", scriptPath);
+        return 74;
+    }
+    if (length > SERVE_MAX_SCRIPT) {
+        free(source);
+        fprintf(stderr, "Script \"%s\" is too large.\n", scriptPath);
+        return 74;
+    }
+
+    int fd = connectTo(socketPath);
+    if (fd < 0) {
+        free(source);
+        return 74;
+    }
+    bool sent = sendFrame(fd, FRAME_SCRIPT, source, (uint32_t)length);
+    free(source);
+
+    int code = sent ? readResponse(fd) : 74;
+    close(fd);
+    return code;
+}
+
+int sendMetricsRequest(const char* socketPath) {
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+        return 74;
+
+    int code = sendFrame(fd, FRAME_METRICS, "", 0) ? readResponse(fd) : 74;
+    close(fd);
+    return code;
+}
@@ -0,0 +1,53 @@
+#ifndef clox_serve_h
+#define clox_serve_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// clox --serve path.sock keeps a pool of warm vms behind a unix socket.
+// a vm is warmed by restoring --restore's snapshot, then running --prelude.
+//
+// both directions talk in frames: a type byte, a little endian uint32
+// length and that many bytes of payload.
+//
+//   client            server
+//   'x' script  -->
+//               <--   'o' output, any number, as the script flushes
+//               <--   's' status, one byte CloxResult + uint64 run nanoseconds
+//
+//   'm'         -->
+//               <--   'o' metrics as text, then 's'
+//
+// one request per connection. compile and runtime errors still go to the
+// server's stderr, the client only gets the status
+#define FRAME_SCRIPT 'x'
+#define FRAME_METRICS 'm'
+#define FRAME_OUTPUT 'o'
+#define FRAME_STATUS 's'
+
+// scripts bigger than this are refused
+#define SERVE_MAX_SCRIPT (64 * 1024 * 1024)
+// accepted connections waiting for a worker, accept() blocks beyond that
+#define SERVE_QUEUE_SIZE 1024
+// a client that sends or reads nothing for this long is dropped, so it
+// can't hold a worker forever
+#define SERVE_TIMEOUT_SECONDS 10
+
+typedef struct {
+    const char* socketPath;
+    int workers;
+    const char* snapshot; // heap restored into every vm first, or NULL
+    const char* prelude;  // script run once per vm before serving, or NULL
+    const char* cacheDir; // NULL keeps compiled chunks in memory only
+    bool log;             // a line per request on stderr
+    int jit;              // jit threshold of every vm, see cloxSetJit()
+} ServeOptions;
+
+// runs until the process is killed, returns an exit code on setup failure
+int serve(const ServeOptions* options);
+// clox --send path.sock script.lox, run a script on a server, exit code
+// like running it locally
+int sendScript(const char* socketPath, const char* scriptPath);
+int sendMetricsRequest(const char* socketPath);
+
+#endif
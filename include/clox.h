@@ -0,0 +1,168 @@
+#ifndef clox_h
+#define clox_h
+
+// public api of libclox, the only header a host program needs.
+//
+// everything is reached through opaque handles, so the structs behind them
+// can change without breaking hosts linked against the shared library.
+// a vm and everything created from it must stay on one thread at a time,
+// different vms can run on different threads at once.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CLOX_API __attribute__((visibility("default")))
+#else
+#define CLOX_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bump the major on any incompatible change of this header, the minor
+// when something is added. CMakeLists.txt reads both from here
+//   1.0  vms, chunks and images, output, globals, the chunk cache
+//   1.1  mark and reset of globals, slices and the scheduler, snapshots,
+//        shared strings, trace and disasm, opstats, the profiler,
+//        allocstats, instruction counts, the jit, emit-c
+#define CLOX_VERSION_MAJOR 1
+#define CLOX_VERSION_MINOR 1
+
+typedef struct CloxVM CloxVM;
+typedef struct CloxChunk CloxChunk;
+typedef struct CloxScheduler CloxScheduler;
+
+typedef enum {
+    CLOX_OK,
+    CLOX_COMPILE_ERROR,
+    CLOX_RUNTIME_ERROR,
+    CLOX_IO_ERROR, // couldn't read the script or image
+    CLOX_YIELD,    // used up its slice, call cloxResume() to go on
+} CloxResult;
+
+// receives the program's output in blocks, whenever the vm flushes
+typedef void (*CloxWriteFn)(void* userdata, const char* chars, size_t length);
+
+// NULL when the stack can't be reserved
+CLOX_API CloxVM* cloxNewVM(void);
+// frees the vm and everything it interned, free its chunks first
+CLOX_API void cloxFreeVM(CloxVM* vm);
+
+// vm settings
+CLOX_API void cloxSetPretokenize(CloxVM* vm, bool pretokenize);
+// debugging output on stdout: every instruction with the stack before it,
+// and each chunk's bytecode before it runs. off by default, runs with
+// tracing off don't pay for it
+CLOX_API void cloxSetTrace(CloxVM* vm, bool trace);
+CLOX_API void cloxSetDisasm(CloxVM* vm, bool disasm);
+// count every instruction the vm runs from now on: per opcode counts and
+// cycles, and the most frequent opcode pairs and triples. the counting
+// happens in its own copy of the dispatch loop, with this off nothing is
+// counted. turning it off drops the counts
+CLOX_API void cloxSetOpStats(CloxVM* vm, bool opstats);
+// report the counts so far, as a table or as json. false if not counting
+CLOX_API bool cloxWriteOpStats(CloxVM* vm, int fd, bool json);
+// instructions counted so far, 0 if not counting
+CLOX_API uint64_t cloxCountedInstructions(CloxVM* vm);
+
+// charge every allocation made on the calling thread to the source line
+// `vm` is running and the c type allocated, until turned off. the report
+// lists the top lines by bytes and by allocation count
+CLOX_API void cloxSetAllocStats(CloxVM* vm, bool allocstats);
+CLOX_API bool cloxWriteAllocStats(CloxVM* vm, int fd);
+
+// sample which source line the running vms are on every `interval`
+// microseconds of cpu time (0 for 1ms), process wide, using SIGPROF. runs
+// don't slow down beyond taking the samples. the report is in the folded
+// stack format flamegraph tools read, see src/profile.h
+CLOX_API bool cloxStartProfile(int interval);
+CLOX_API void cloxStopProfile(void);
+CLOX_API bool cloxWriteProfile(int fd);
+CLOX_API void cloxSetOutputBuffer(CloxVM* vm, size_t bytes);
+CLOX_API void cloxSetOutputFd(CloxVM* vm, int fd);
+CLOX_API void cloxSetOutputCallback(CloxVM* vm, CloxWriteFn write, void* userdata);
+CLOX_API void cloxFlush(CloxVM* vm);
+// reuse compiled chunks by source hash, kept as images under `dir` (NULL
+// for in memory only). `dir` must outlive the vm
+CLOX_API void cloxSetCacheDir(CloxVM* vm, const char* dir);
+// let every run or resume execute at most `instructions` before it returns
+// CLOX_YIELD, 0 (the default) for no limit
+CLOX_API void cloxSetSlice(CloxVM* vm, uint64_t instructions);
+// compile a chunk to x86-64 machine code on its `threshold`th run and run
+// that from then on, 0 (the default) to always interpret. 1 compiles every
+// chunk before its first run. chunks run with tracing, opstats or the
+// profiler on, or bigger than the slice, are always interpreted
+CLOX_API void cloxSetJit(CloxVM* vm, int threshold);
+
+// compile and run in one go, `source` doesn't have to be '\0' terminated
+CLOX_API CloxResult cloxInterpret(CloxVM* vm, const char* source, size_t length);
+// run a script or a .loxc image, told apart by the file's magic
+CLOX_API CloxResult cloxRunFile(CloxVM* vm, const char* path);
+CLOX_API bool cloxIsImage(const char* path);
+
+// compile once, run many times. a chunk belongs to the vm that made it
+CLOX_API CloxResult cloxCompile(CloxVM* vm, const char* source, size_t length, CloxChunk** chunk);
+CLOX_API CloxResult cloxCompileFile(CloxVM* vm, const char* path, CloxChunk** chunk);
+CLOX_API CloxResult cloxLoadImage(CloxVM* vm, const char* path, CloxChunk** chunk);
+CLOX_API bool cloxSaveImage(CloxChunk* chunk, const char* path);
+// write the chunk out as a c program, built against libclox.a into a native
+// executable that runs the script. `name` goes into a comment, see
+// src/emitc.h for how to build it
+CLOX_API bool cloxEmitC(CloxChunk* chunk, const char* name, const char* path);
+CLOX_API CloxResult cloxRun(CloxVM* vm, CloxChunk* chunk);
+CLOX_API void cloxFreeChunk(CloxChunk* chunk);
+
+// continue after CLOX_YIELD, with ip and stack as they were. a yielded
+// cloxRun() needs its chunk alive until the run finishes, starting another
+// script drops the suspended one
+CLOX_API CloxResult cloxResume(CloxVM* vm);
+CLOX_API bool cloxIsSuspended(CloxVM* vm);
+
+// define or overwrite a global, visible to every script run afterwards
+CLOX_API void cloxSetNil(CloxVM* vm, const char* name);
+CLOX_API void cloxSetBool(CloxVM* vm, const char* name, bool value);
+CLOX_API void cloxSetNumber(CloxVM* vm, const char* name, double value);
+CLOX_API void cloxSetString(CloxVM* vm, const char* name, const char* chars, size_t length);
+
+// save the vm's strings and globals, and load them into a fresh vm, so a
+// prelude doesn't have to run on every start. see src/snapshot.h
+CLOX_API bool cloxSaveSnapshot(CloxVM* vm, const char* path);
+CLOX_API bool cloxRestoreSnapshot(CloxVM* vm, const char* path);
+
+// move every string `vm` interned into one process wide, read-only set and
+// freeze it, once. vms created afterwards (and `vm` itself) look strings up
+// there first, lock free from any thread, instead of interning their own
+// copies. false if the set is already frozen
+CLOX_API bool cloxShareStrings(CloxVM* vm);
+
+// remember the current globals (say after running a prelude), and later
+// throw away whatever scripts defined since, and free the strings they
+// made. a reset without a mark clears all globals. chunks compiled or
+// loaded since the mark can't run after a reset, free them before
+CLOX_API void cloxMarkGlobals(CloxVM* vm);
+CLOX_API void cloxResetGlobals(CloxVM* vm);
+
+// round robin over many vms on a few threads. every scheduled run gets
+// `slice` instructions at a time, then goes to the back of the queue, so
+// a long script can't hold up the short ones behind it.
+// `done` is called on a scheduler thread when a run finishes
+typedef void (*CloxDoneFn)(void* userdata, CloxVM* vm, CloxResult result);
+
+// NULL when the threads can't be started
+CLOX_API CloxScheduler* cloxNewScheduler(int threads, uint64_t slice);
+// a vm must not be scheduled again or used otherwise until its `done`
+CLOX_API void cloxSchedule(CloxScheduler* scheduler, CloxVM* vm, CloxChunk* chunk, CloxDoneFn done,
+                           void* userdata);
+// block until every scheduled run is done
+CLOX_API void cloxWaitScheduler(CloxScheduler* scheduler);
+// waits for the scheduled runs, then stops the threads
+CLOX_API void cloxFreeScheduler(CloxScheduler* scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocstats.h"
+#include "vm.h"
+
+AllocStats* newAllocStats() {
+    AllocStats* stats = calloc(1, sizeof(AllocStats));
+    if (stats == NULL)
+        exit(1);
+    return stats;
+}
+
+void freeAllocStats(AllocStats* stats) {
+    free(stats->sites);
+    free(stats);
+}
+
+// FNV-1a over the type name and the line
+static uint32_t hashSite(int line, const char* type) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = type; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619;
+    }
+    hash ^= (uint32_t)line;
+    hash *= 16777619;
+    return hash;
+}
+
+static AllocSite* findSite(AllocSite* sites, int capacity, int line, const char* type) {
+    uint32_t index = hashSite(line, type) & (capacity - 1);
+    while (sites[index].type != NULL && (sites[index].line != line || strcmp(sites[index].type, type) != 0))
+        index = (index + 1) & (capacity - 1);
+    return &sites[index];
+}
+
+// capacities stay powers of two, at most half full
+static void growSites(AllocStats* stats) {
+    int capacity = stats->capacity < 64 ? 64 : stats->capacity * 2;
+    AllocSite* sites = calloc(capacity, sizeof(AllocSite));
+    if (sites == NULL)
+        exit(1);
+
+    for (int i = 0; i < stats->capacity; i++) {
+        AllocSite* site = &stats->sites[i];
+        if (site->type != NULL)
+            *findSite(sites, capacity, site->line, site->type) = *site;
+    }
+    free(stats->sites);
+    stats->sites = sites;
+    stats->capacity = capacity;
+}
+
+void recordAllocation(VM* vm, const char* type, size_t bytes) {
+    AllocStats* stats = vm->allocstats;
+    int line = 0;
+    if (vm->running) {
+        // `ip` is already past the opcode being run
+        int offset = (int)(vm->ip - vm->chunk->code) - 1;
+        line = chunkGetLine(vm->chunk, offset < 0 ? 0 : offset);
+    }
+
+    if (stats->count + 1 > stats->capacity / 2)
+        growSites(stats);
+    AllocSite* site = findSite(stats->sites, stats->capacity, line, type);
+    if (site->type == NULL) {
+        site->line = line;
+        site->type = type;
+        stats->count++;
+    }
+    site->bytes += bytes;
+    site->count++;
+}
+
+// most first, ties in line order
+static int compareSites(uint64_t a, uint64_t b, const AllocSite* siteA, const AllocSite* siteB) {
+    if (a != b)
+        return (a < b) - (a > b);
+    return (siteA->line > siteB->line) - (siteA->line < siteB->line);
+}
+
+static int compareBytes(const void* a, const void* b) {
+    const AllocSite* siteA = (const AllocSite*)a;
+    const AllocSite* siteB = (const AllocSite*)b;
+    return compareSites(siteA->bytes, siteB->bytes, siteA, siteB);
+}
+
+static int compareCounts(const void* a, const void* b) {
+    const AllocSite* siteA = (const AllocSite*)a;
+    const AllocSite* siteB = (const AllocSite*)b;
+    return compareSites(siteA->count, siteB->count, siteA, siteB);
+}
+
+static void writeSites(int fd, const char* title, AllocSite* sites, int count) {
+    dprintf(fd, "\ntop lines by %s\n", title);
+    dprintf(fd, "%14s %10s %6s  %s\n", "bytes", "count", "line", "type");
+    for (int i = 0; i < count && i < ALLOCSTATS_TOP; i++) {
+        if (sites[i].line == 0) {
+            dprintf(fd, "%14llu %10llu %6s  %s\n", (unsigned long long)sites[i].bytes,
+                    (unsigned long long)sites[i].count, "-", sites[i].type);
+        } else {
+            dprintf(fd, "%14llu %10llu %6d  %s\n", (unsigned long long)sites[i].bytes,
+                    (unsigned long long)sites[i].count, sites[i].line, sites[i].type);
+        }
+    }
+}
+
+void writeAllocStats(AllocStats* stats, int fd) {
+    AllocSite* sites = calloc(stats->count > 0 ? stats->count : 1, sizeof(AllocSite));
+    if (sites == NULL)
+        return;
+
+    int count = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    for (int i = 0; i < stats->capacity; i++) {
+        if (stats->sites[i].type == NULL)
+            continue;
+        bytes += stats->sites[i].bytes;
+        allocations += stats->sites[i].count;
+        sites[count++] = stats->sites[i];
+    }
+
+    dprintf(fd, "allocations: %llu, bytes: %llu (line - is outside of any run)\n", (unsigned long long)allocations,
+            (unsigned long long)bytes);
+    qsort(sites, count, sizeof(AllocSite), compareBytes);
+    writeSites(fd, "bytes", sites, count);
+    qsort(sites, count, sizeof(AllocSite), compareCounts);
+    writeSites(fd, "count", sites, count);
+    free(sites);
+}
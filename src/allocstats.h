@@ -0,0 +1,38 @@
+#ifndef clox_allocstats_h
+#define clox_allocstats_h
+
+#include "chunk.h"
+#include "common.h"
+
+// the allocation profiler behind --allocstats. every growing reallocate()
+// on the tracking thread is charged to an allocation site: the source line
+// the vm is running, and the c type allocated (`char` for string contents,
+// `ObjString`, `Entry` for table slots...). allocations outside of any run,
+// compiling mostly, go to line 0.
+//
+// the sites live in a hash table of their own, allocated with plain
+// calloc(), so recording doesn't allocate through reallocate() again
+
+// sites shown per list in a report
+#define ALLOCSTATS_TOP 10
+
+typedef struct {
+    int line;
+    const char* type; // a string literal, lives as long as the program
+    uint64_t bytes;
+    uint64_t count;
+} AllocSite;
+
+typedef struct {
+    int count;
+    int capacity;
+    AllocSite* sites;
+} AllocStats;
+
+AllocStats* newAllocStats();
+void freeAllocStats(AllocStats* stats);
+void recordAllocation(VM* vm, const char* type, size_t bytes);
+// the top sites by bytes and by count
+void writeAllocStats(AllocStats* stats, int fd);
+
+#endif
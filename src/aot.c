@@ -0,0 +1,51 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aot.h"
+#include "memory.h"
+
+InterpretResult aotError(VM* vm, int line, const char* format, ...) {
+    // keep what the script printed so far in front of the error
+    flushOutput(&vm->output);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputs("\n", stderr);
+
+    fprintf(stderr, "[line %d] in script\n", line);
+    return INTERPRET_RUNTIME_ERROR;
+}
+
+Value aotConcatenate(VM* vm, Value a, Value b) {
+    ObjString* left = AS_STRING(a);
+    ObjString* right = AS_STRING(b);
+
+    int length = left->length + right->length;
+    char* chars = ALLOCATE(char, length + 1);
+    memcpy(chars, left->chars, left->length);
+    memcpy(chars + left->length, right->chars, right->length);
+    chars[length] = '\0';
+
+    return OBJ_VAL(takeString(vm, chars, length));
+}
+
+void aotPrint(VM* vm, Value value) {
+    writeValue(&vm->output, value);
+    writeOutput(&vm->output, "\n", 1);
+}
+
+int aotMain(AotScript script) {
+    VM vm;
+    if (!initVM(&vm)) {
+        fprintf(stderr, "Could not reserve the value stack.\n");
+        return 1;
+    }
+
+    InterpretResult result = script(&vm);
+    flushOutput(&vm.output);
+    freeVM(&vm);
+    return result == INTERPRET_RUNTIME_ERROR ? 70 : 0;
+}
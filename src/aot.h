@@ -0,0 +1,61 @@
+#ifndef clox_aot_h
+#define clox_aot_h
+
+#include <math.h>
+
+#include "common.h"
+#include "object.h"
+#include "table.h"
+#include "value.h"
+#include "vm.h"
+
+// the runtime of the programs clox --emit-c writes, see emitc.h. a program
+// is one function with a c statement per instruction of the chunk it came
+// from and the value stack as local variables, so the c compiler sees the
+// types and optimizes across instructions. values, strings and globals are
+// the interpreter's own, and errors read the same as run()'s.
+//
+// the programs link against libclox.a and include this from src/
+
+typedef InterpretResult (*AotScript)(VM* vm);
+
+// OP_GREATER, OP_LESS, OP_SUBTRACT... on two stack slots, in a script
+// function where `vm` is in scope
+#define AOT_BINARY(a, b, valueType, op, line)                                                                          \
+    do {                                                                                                               \
+        if (!IS_NUMBER(a) || !IS_NUMBER(b))                                                                            \
+            return aotError(vm, line, "Operands must be numbers.");                                                    \
+        a = valueType(AS_NUMBER(a) op AS_NUMBER(b));                                                                   \
+    } while (false)
+
+#define AOT_ADD(a, b, line)                                                                                            \
+    do {                                                                                                               \
+        if (IS_STRING(a) && IS_STRING(b)) {                                                                            \
+            a = aotConcatenate(vm, a, b);                                                                              \
+        } else if (IS_NUMBER(a) && IS_NUMBER(b)) {                                                                     \
+            a = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));                                                               \
+        } else {                                                                                                       \
+            return aotError(vm, line, "Operands must be two numbers or two strings.");                                 \
+        }                                                                                                              \
+    } while (false)
+
+#define AOT_NEGATE(a, line)                                                                                            \
+    do {                                                                                                               \
+        if (!IS_NUMBER(a))                                                                                             \
+            return aotError(vm, line, "Operand must be a number.");                                                    \
+        a = NUMBER_VAL(-AS_NUMBER(a));                                                                                 \
+    } while (false)
+
+static inline bool aotIsFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// prints the error and the line like run() does, and gives the result to
+// return from the script
+InterpretResult aotError(VM* vm, int line, const char* format, ...);
+Value aotConcatenate(VM* vm, Value a, Value b);
+void aotPrint(VM* vm, Value value);
+// run `script` on a fresh vm, the exit code is the same as the cli's
+int aotMain(AotScript script);
+
+#endif
@@ -0,0 +1,334 @@
+// libclox, the public api from include/clox.h on top of the vm internals
+#include <string.h>
+
+#include "allocstats.h"
+#include "cache.h"
+#include "chunk.h"
+#include "clox.h"
+#include "common.h"
+#include "emitc.h"
+#include "image.h"
+#include "intern.h"
+#include "memory.h"
+#include "object.h"
+#include "opstats.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "source.h"
+#include "table.h"
+#include "vm.h"
+
+struct CloxVM {
+    VM vm;
+    ChunkCache cache;
+    // see cloxMarkGlobals()
+    Table markedGlobals;
+    Obj* markedObjects;
+};
+
+// an image whose mapping is NULL for chunks compiled in process, so one
+// freeImage() covers both kinds
+struct CloxChunk {
+    Image image;
+};
+
+CloxVM* cloxNewVM(void) {
+    CloxVM* clox = ALLOCATE(CloxVM, 1);
+    if (!initVM(&clox->vm)) {
+        FREE(CloxVM, clox);
+        return NULL;
+    }
+    initTable(&clox->markedGlobals);
+    clox->markedObjects = NULL;
+    return clox;
+}
+
+void cloxFreeVM(CloxVM* clox) {
+    if (clox->vm.cache != NULL)
+        freeChunkCache(clox->vm.cache);
+    freeTable(&clox->markedGlobals);
+    freeVM(&clox->vm);
+    FREE(CloxVM, clox);
+}
+
+void cloxSetPretokenize(CloxVM* clox, bool pretokenize) {
+    clox->vm.pretokenize = pretokenize;
+}
+
+void cloxSetTrace(CloxVM* clox, bool trace) {
+    clox->vm.trace = trace;
+}
+
+void cloxSetDisasm(CloxVM* clox, bool disasm) {
+    clox->vm.disasm = disasm;
+}
+
+void cloxSetOpStats(CloxVM* clox, bool opstats) {
+    if (opstats && clox->vm.opstats == NULL)
+        clox->vm.opstats = newOpStats();
+    if (!opstats && clox->vm.opstats != NULL) {
+        freeOpStats(clox->vm.opstats);
+        clox->vm.opstats = NULL;
+    }
+}
+
+bool cloxWriteOpStats(CloxVM* clox, int fd, bool json) {
+    if (clox->vm.opstats == NULL)
+        return false;
+    writeOpStats(clox->vm.opstats, fd, json);
+    return true;
+}
+
+uint64_t cloxCountedInstructions(CloxVM* clox) {
+    if (clox->vm.opstats == NULL)
+        return 0;
+    uint64_t count = 0;
+    for (int i = 0; i < OP_COUNT; i++)
+        count += clox->vm.opstats->counts[i];
+    return count;
+}
+
+void cloxSetAllocStats(CloxVM* clox, bool allocstats) {
+    if (allocstats && clox->vm.allocstats == NULL)
+        clox->vm.allocstats = newAllocStats();
+    if (!allocstats && clox->vm.allocstats != NULL) {
+        freeAllocStats(clox->vm.allocstats);
+        clox->vm.allocstats = NULL;
+    }
+}
+
+bool cloxWriteAllocStats(CloxVM* clox, int fd) {
+    if (clox->vm.allocstats == NULL)
+        return false;
+    writeAllocStats(clox->vm.allocstats, fd);
+    return true;
+}
+
+bool cloxStartProfile(int interval) {
+    return startProfile(interval > 0 ? interval : PROFILE_INTERVAL);
+}
+
+void cloxStopProfile(void) {
+    stopProfile();
+}
+
+bool cloxWriteProfile(int fd) {
+    return writeProfile(fd);
+}
+
+void cloxSetOutputBuffer(CloxVM* clox, size_t bytes) {
+    resizeOutput(&clox->vm.output, bytes);
+}
+
+void cloxSetOutputFd(CloxVM* clox, int fd) {
+    setOutputFd(&clox->vm.output, fd);
+}
+
+void cloxSetOutputCallback(CloxVM* clox, CloxWriteFn write, void* userdata) {
+    setOutputCallback(&clox->vm.output, write, userdata);
+}
+
+void cloxFlush(CloxVM* clox) {
+    flushOutput(&clox->vm.output);
+}
+
+void cloxSetCacheDir(CloxVM* clox, const char* dir) {
+    if (clox->vm.cache != NULL)
+        freeChunkCache(clox->vm.cache);
+    initChunkCache(&clox->cache, dir, CACHE_MAX_ENTRIES, CACHE_MAX_BYTES, CACHE_MAX_DISK_BYTES);
+    clox->vm.cache = &clox->cache;
+}
+
+void cloxSetSlice(CloxVM* clox, uint64_t instructions) {
+    clox->vm.slice = instructions;
+}
+
+void cloxSetJit(CloxVM* clox, int threshold) {
+    clox->vm.jitThreshold = threshold > 0 ? threshold : 0;
+}
+
+// InterpretResult and CloxResult are kept apart so the public values never
+// move when the vm grows new results
+static CloxResult toCloxResult(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_OK:
+            return CLOX_OK;
+        case INTERPRET_COMPILE_ERROR:
+            return CLOX_COMPILE_ERROR;
+        case INTERPRET_RUNTIME_ERROR:
+            return CLOX_RUNTIME_ERROR;
+        case INTERPRET_IO_ERROR:
+            return CLOX_IO_ERROR;
+        case INTERPRET_YIELD:
+            return CLOX_YIELD;
+    }
+    return CLOX_RUNTIME_ERROR;
+}
+
+// the thread's allocations go to the vm's stats only for the length of one
+// compile or run, a thread may take turns on several vms (the scheduler's
+// do) and a vm may move between threads
+static void enterTracking(CloxVM* clox) {
+    if (clox->vm.allocstats != NULL)
+        trackAllocations(&clox->vm);
+}
+
+static void leaveTracking(CloxVM* clox) {
+    if (clox->vm.allocstats != NULL)
+        trackAllocations(NULL);
+}
+
+CloxResult cloxInterpret(CloxVM* clox, const char* source, size_t length) {
+    enterTracking(clox);
+    InterpretResult result = interpretSource(&clox->vm, source, length);
+    leaveTracking(clox);
+    return toCloxResult(result);
+}
+
+bool cloxIsImage(const char* path) {
+    return isImageFile(path);
+}
+
+CloxResult cloxRunFile(CloxVM* clox, const char* path) {
+    enterTracking(clox);
+    InterpretResult result = isImageFile(path) ? interpretImage(&clox->vm, path) : interpretFile(&clox->vm, path);
+    leaveTracking(clox);
+    return toCloxResult(result);
+}
+
+static CloxChunk* newChunk() {
+    CloxChunk* chunk = ALLOCATE(CloxChunk, 1);
+    initChunk(&chunk->image.chunk);
+    chunk->image.mapping = NULL;
+    chunk->image.size = 0;
+    return chunk;
+}
+
+CloxResult cloxCompile(CloxVM* clox, const char* source, size_t length, CloxChunk** out) {
+    CloxChunk* chunk = newChunk();
+    enterTracking(clox);
+    bool compiled = compileSource(&clox->vm, source, length, &chunk->image.chunk);
+    leaveTracking(clox);
+    if (!compiled) {
+        cloxFreeChunk(chunk);
+        *out = NULL;
+        return CLOX_COMPILE_ERROR;
+    }
+    *out = chunk;
+    return CLOX_OK;
+}
+
+CloxResult cloxCompileFile(CloxVM* clox, const char* path, CloxChunk** out) {
+    Source source;
+    if (!openSource(&source, path)) {
+        *out = NULL;
+        return CLOX_IO_ERROR;
+    }
+
+    CloxResult result = cloxCompile(clox, source.chars, source.length, out);
+    closeSource(&source);
+    return result;
+}
+
+CloxResult cloxLoadImage(CloxVM* clox, const char* path, CloxChunk** out) {
+    CloxChunk* chunk = ALLOCATE(CloxChunk, 1);
+    enterTracking(clox);
+    bool loaded = loadImage(&clox->vm, &chunk->image, path);
+    leaveTracking(clox);
+    if (!loaded) {
+        FREE(CloxChunk, chunk);
+        *out = NULL;
+        return CLOX_IO_ERROR;
+    }
+    *out = chunk;
+    return CLOX_OK;
+}
+
+bool cloxSaveImage(CloxChunk* chunk, const char* path) {
+    return writeImage(&chunk->image.chunk, path);
+}
+
+bool cloxEmitC(CloxChunk* chunk, const char* name, const char* path) {
+    return writeC(&chunk->image.chunk, name, path);
+}
+
+CloxResult cloxRun(CloxVM* clox, CloxChunk* chunk) {
+    enterTracking(clox);
+    InterpretResult result = interpretChunk(&clox->vm, &chunk->image.chunk);
+    leaveTracking(clox);
+    return toCloxResult(result);
+}
+
+CloxResult cloxResume(CloxVM* clox) {
+    enterTracking(clox);
+    InterpretResult result = resume(&clox->vm);
+    leaveTracking(clox);
+    return toCloxResult(result);
+}
+
+bool cloxIsSuspended(CloxVM* clox) {
+    return clox->vm.suspended;
+}
+
+void cloxFreeChunk(CloxChunk* chunk) {
+    freeImage(&chunk->image);
+    FREE(CloxChunk, chunk);
+}
+
+static void setGlobal(CloxVM* clox, const char* name, Value value) {
+    ObjString* key = copyString(&clox->vm, name, (int)strlen(name));
+    tableSet(&clox->vm.globals, key, value);
+}
+
+void cloxSetNil(CloxVM* clox, const char* name) {
+    setGlobal(clox, name, NIL_VAL);
+}
+
+void cloxSetBool(CloxVM* clox, const char* name, bool value) {
+    setGlobal(clox, name, BOOL_VAL(value));
+}
+
+void cloxSetNumber(CloxVM* clox, const char* name, double value) {
+    setGlobal(clox, name, NUMBER_VAL(value));
+}
+
+void cloxSetString(CloxVM* clox, const char* name, const char* chars, size_t length) {
+    setGlobal(clox, name, OBJ_VAL(copyString(&clox->vm, chars, (int)length)));
+}
+
+bool cloxSaveSnapshot(CloxVM* clox, const char* path) {
+    return writeSnapshot(&clox->vm, path);
+}
+
+bool cloxRestoreSnapshot(CloxVM* clox, const char* path) {
+    return loadSnapshot(&clox->vm, path);
+}
+
+bool cloxShareStrings(CloxVM* clox) {
+    if (!shareStrings(&clox->vm))
+        return false;
+    // the objects went to the shared set, marked ones included
+    clox->markedObjects = NULL;
+    return true;
+}
+
+void cloxMarkGlobals(CloxVM* clox) {
+    freeTable(&clox->markedGlobals);
+    tableAddAll(&clox->vm.globals, &clox->markedGlobals);
+    clox->markedObjects = clox->vm.objects;
+}
+
+// whatever scripts allocated since the mark goes too, or a vm serving
+// requests keeps every string they ever made. only the constants of
+// cached chunks stay, the next hit runs them
+void cloxResetGlobals(CloxVM* clox) {
+    freeTable(&clox->vm.globals);
+    tableAddAll(&clox->markedGlobals, &clox->vm.globals);
+
+    Table keep;
+    initTable(&keep);
+    if (clox->vm.cache != NULL)
+        cacheKeepConstants(clox->vm.cache, &keep);
+    freeObjectsSince(&clox->vm, clox->markedObjects, &keep);
+    freeTable(&keep);
+}
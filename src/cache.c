@@ -0,0 +1,204 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "compiler.h"
+#include "memory.h"
+#include "object.h"
+
+void initChunkCache(ChunkCache* cache, const char* dir, int maxEntries, size_t maxBytes, size_t maxDiskBytes) {
+    cache->entries = ALLOCATE(CacheEntry, maxEntries);
+    cache->count = 0;
+    cache->maxEntries = maxEntries;
+    cache->bytes = 0;
+    cache->maxBytes = maxBytes;
+    cache->clock = 0;
+    cache->dir = dir;
+    cache->maxDiskBytes = maxDiskBytes;
+
+    // fine if it already exists, a failing write later just skips the disk
+    if (dir != NULL)
+        mkdir(dir, 0755);
+}
+
+void freeChunkCache(ChunkCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        freeImage(&cache->entries[i].image);
+    }
+    FREE_ARRAY(CacheEntry, cache->entries, cache->maxEntries);
+    cache->entries = NULL;
+    cache->count = 0;
+    cache->bytes = 0;
+}
+
+void cacheKey(const char* source, size_t length, uint8_t key[SHA256_SIZE]) {
+    uint32_t version = COMPILER_VERSION;
+    Sha256 sha;
+    initSha256(&sha);
+    updateSha256(&sha, &version, sizeof(version));
+    updateSha256(&sha, source, length);
+    finishSha256(&sha, key);
+}
+
+static void imagePath(ChunkCache* cache, const uint8_t key[SHA256_SIZE], char* path, size_t size) {
+    char hex[SHA256_SIZE * 2 + 1];
+    for (int i = 0; i < SHA256_SIZE; i++) {
+        snprintf(hex + i * 2, 3, "%02x", key[i]);
+    }
+    snprintf(path, size, "%s/%s.loxc", cache->dir, hex);
+}
+
+// memory held by a cached chunk, roughly. the strings its constants keep
+// alive count too, or a vm serving many scripts grows past `maxBytes`
+static size_t chunkBytes(Image* image) {
+    Chunk* chunk = &image->chunk;
+    size_t bytes = sizeof(Value) * chunk->constants.capacity;
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (IS_STRING(value))
+            bytes += sizeof(ObjString) + AS_STRING(value)->length + 1;
+    }
+
+    if (image->mapping != NULL)
+        return bytes + image->size;
+    return bytes + chunk->capacity + sizeof(int) * chunk->line_encodings.capacity;
+}
+
+static void evictLeastRecentlyUsed(ChunkCache* cache) {
+    int oldest = 0;
+    for (int i = 1; i < cache->count; i++) {
+        if (cache->entries[i].lastUsed < cache->entries[oldest].lastUsed)
+            oldest = i;
+    }
+
+    CacheEntry* entry = &cache->entries[oldest];
+    cache->bytes -= entry->bytes;
+    freeImage(&entry->image);
+
+    // fill the hole with the last entry
+    cache->count--;
+    if (oldest != cache->count)
+        *entry = cache->entries[cache->count];
+}
+
+static Chunk* insert(ChunkCache* cache, const uint8_t key[SHA256_SIZE], Image* image) {
+    size_t bytes = chunkBytes(image);
+    while (cache->count > 0 && (cache->count >= cache->maxEntries || cache->bytes + bytes > cache->maxBytes)) {
+        evictLeastRecentlyUsed(cache);
+    }
+
+    CacheEntry* entry = &cache->entries[cache->count++];
+    memcpy(entry->key, key, SHA256_SIZE);
+    entry->image = *image;
+    entry->bytes = bytes;
+    entry->lastUsed = ++cache->clock;
+    cache->bytes += bytes;
+    return &entry->image.chunk;
+}
+
+// keep the images on disk under `maxDiskBytes`, oldest modified go first.
+// hits touch their file, so that's least recently used as well
+static void trimDirectory(ChunkCache* cache) {
+    while (true) {
+        DIR* dir = opendir(cache->dir);
+        if (dir == NULL)
+            return;
+
+        char path[4096];
+        char oldestPath[4096] = "";
+        struct timespec oldest = {0, 0};
+        size_t total = 0;
+
+        struct dirent* file;
+        while ((file = readdir(dir)) != NULL) {
+            size_t length = strlen(file->d_name);
+            if (length < 5 || strcmp(file->d_name + length - 5, ".loxc") != 0)
+                continue;
+
+            snprintf(path, sizeof(path), "%s/%s", cache->dir, file->d_name);
+            struct stat info;
+            if (stat(path, &info) < 0)
+                continue;
+
+            total += info.st_size;
+            if (oldestPath[0] == '\0' || info.st_mtim.tv_sec < oldest.tv_sec ||
+                (info.st_mtim.tv_sec == oldest.tv_sec && info.st_mtim.tv_nsec < oldest.tv_nsec)) {
+                oldest = info.st_mtim;
+                memcpy(oldestPath, path, sizeof(path));
+            }
+        }
+        closedir(dir);
+
+        if (total <= cache->maxDiskBytes || oldestPath[0] == '\0')
+            return;
+        unlink(oldestPath);
+    }
+}
+
+// vms on other threads share the directory, two trims at once would both
+// count the same files and delete more than needed
+static void trimDisk(ChunkCache* cache) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&lock);
+    trimDirectory(cache);
+    pthread_mutex_unlock(&lock);
+}
+
+// NULL on a miss, the chunk stays owned by the cache
+// `vm` interns the constants of a chunk loaded from disk
+Chunk* cacheGet(ChunkCache* cache, VM* vm, const uint8_t key[SHA256_SIZE]) {
+    for (int i = 0; i < cache->count; i++) {
+        CacheEntry* entry = &cache->entries[i];
+        if (memcmp(entry->key, key, SHA256_SIZE) == 0) {
+            entry->lastUsed = ++cache->clock;
+            return &entry->image.chunk;
+        }
+    }
+
+    if (cache->dir == NULL)
+        return NULL;
+
+    char path[4096];
+    imagePath(cache, key, path, sizeof(path));
+    if (access(path, R_OK) != 0)
+        return NULL;
+
+    Image image;
+    if (!loadImage(vm, &image, path))
+        return NULL;
+
+    // mark it used for the disk LRU
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return insert(cache, key, &image);
+}
+
+// the cache takes over `chunk`, use the returned one from here on
+Chunk* cachePut(ChunkCache* cache, const uint8_t key[SHA256_SIZE], Chunk* chunk) {
+    if (cache->dir != NULL) {
+        char path[4096];
+        imagePath(cache, key, path, sizeof(path));
+        if (writeImage(chunk, path))
+            trimDisk(cache);
+    }
+
+    Image image;
+    image.chunk = *chunk;
+    image.mapping = NULL;
+    image.size = 0;
+    return insert(cache, key, &image);
+}
+
+void cacheKeepConstants(ChunkCache* cache, Table* keep) {
+    for (int i = 0; i < cache->count; i++) {
+        ValueArray* constants = &cache->entries[i].image.chunk.constants;
+        for (int j = 0; j < constants->count; j++) {
+            if (IS_STRING(constants->values[j]))
+                tableSet(keep, AS_STRING(constants->values[j]), NIL_VAL);
+        }
+    }
+}
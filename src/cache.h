@@ -0,0 +1,48 @@
+#ifndef clox_cache_h
+#define clox_cache_h
+
+#include "chunk.h"
+#include "common.h"
+#include "image.h"
+#include "sha256.h"
+#include "table.h"
+
+#define CACHE_MAX_ENTRIES 512
+#define CACHE_MAX_BYTES (64 * 1024 * 1024)
+#define CACHE_MAX_DISK_BYTES (256 * 1024 * 1024)
+
+// compiled chunks keyed by sha256(COMPILER_VERSION, source). entries are
+// kept in process and, with a `dir`, as .loxc images on disk.
+//
+// the constants of a cached chunk are interned in the vm that compiled it,
+// so a cache belongs to exactly one vm
+typedef struct {
+    uint8_t key[SHA256_SIZE];
+    Image image;
+    size_t bytes;
+    uint64_t lastUsed;
+} CacheEntry;
+
+typedef struct {
+    // allocated once with `maxEntries` slots, so an entry's chunk doesn't
+    // move while it's running
+    CacheEntry* entries;
+    int count;
+    int maxEntries;
+    size_t bytes;
+    size_t maxBytes;
+    uint64_t clock; // bumped on every use, for LRU
+    const char* dir;
+    size_t maxDiskBytes;
+} ChunkCache;
+
+void initChunkCache(ChunkCache* cache, const char* dir, int maxEntries, size_t maxBytes, size_t maxDiskBytes);
+void freeChunkCache(ChunkCache* cache);
+void cacheKey(const char* source, size_t length, uint8_t key[SHA256_SIZE]);
+Chunk* cacheGet(ChunkCache* cache, VM* vm, const uint8_t key[SHA256_SIZE]);
+Chunk* cachePut(ChunkCache* cache, const uint8_t key[SHA256_SIZE], Chunk* chunk);
+// add the string constants of every cached chunk to `keep`, they have to
+// outlive a reset of the vm, see cloxResetGlobals()
+void cacheKeepConstants(ChunkCache* cache, Table* keep);
+
+#endif
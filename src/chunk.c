@@ -1,4 +1,5 @@
 #include "chunk.h"
+#include "jit.h"
 #include "memory.h"
 #include "value.h"
 #include <stdio.h>
@@ -8,6 +9,9 @@ void initChunk(Chunk* chunk) {
     chunk->count = 0;
     chunk->capacity = 0;
     chunk->code = NULL;
+    chunk->maxStack = -1;
+    chunk->jit = NULL;
+    chunk->runs = 0;
     initValueArray(&chunk->constants);
 
     RLE_LineEncoding line_encodings;
@@ -16,6 +20,7 @@ void initChunk(Chunk* chunk) {
 }
 
 void freeChunk(Chunk* chunk) {
+    freeJit(chunk->jit);
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
     freeValueArray(&chunk->constants);
     freeEncoding(&chunk->line_encodings);
@@ -32,6 +37,7 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
 
     chunk->code[chunk->count] = byte;
     chunk->count++;
+    chunk->maxStack = -1;
     writeLine(&chunk->line_encodings, line);
 }
 
@@ -47,14 +53,23 @@ int chunkGetLine(Chunk* chunk, int index) {
     return getEncodingLine(&chunk->line_encodings, index);
 }
 
+int chunkFindLine(const Chunk* chunk, int index) {
+    return findEncodingLine(&chunk->line_encodings, index);
+}
+
 // start RLE
 void initEncoding(RLE_LineEncoding* encoding) {
     encoding->count = 0;
     encoding->capacity = 0;
     encoding->encodings = NULL;
+    encoding->runEnds = NULL;
+    encoding->indexed = 0;
+    encoding->indexCapacity = 0;
+    encoding->cursor = 0;
 }
 void freeEncoding(RLE_LineEncoding* encoding) {
     FREE_ARRAY(int, encoding->encodings, encoding->capacity);
+    FREE_ARRAY(int, encoding->runEnds, encoding->indexCapacity);
     initEncoding(encoding);
 }
 
@@ -63,6 +78,10 @@ void writeLine(RLE_LineEncoding* encoding, int line) {
     if (encoding->encodings != NULL && line == encoding->encodings[encoding->count - 1]) {
         // only increase the same line's count no
         encoding->encodings[encoding->count - 2]++;
+        // the last run's end moved, index it again
+        int last = encoding->count / 2 - 1;
+        if (encoding->indexed > last)
+            encoding->indexed = last;
     } else {
         // overflow case
         if (encoding->capacity < encoding->count + 1) {
@@ -79,22 +98,64 @@ void writeLine(RLE_LineEncoding* encoding, int line) {
     }
 }
 
+// bring the index up to date with the runs written since the last lookup
+void indexEncoding(RLE_LineEncoding* encoding) {
+    int runs = encoding->count / 2;
+    if (encoding->indexCapacity < runs) {
+        int oldCapacity = encoding->indexCapacity;
+        encoding->indexCapacity = encoding->capacity / 2 > runs ? encoding->capacity / 2 : runs;
+        encoding->runEnds = GROW_ARRAY(int, encoding->runEnds, oldCapacity, encoding->indexCapacity);
+    }
+
+    int end = encoding->indexed == 0 ? 0 : encoding->runEnds[encoding->indexed - 1];
+    for (int run = encoding->indexed; run < runs; run++) {
+        end += encoding->encodings[run * 2];
+        encoding->runEnds[run] = end;
+    }
+    encoding->indexed = runs;
+}
+
+// the first run ending after `index`, the last one past the end
+static int findRun(const int* ends, int runs, int index) {
+    int low = 0;
+    int high = runs - 1;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (ends[middle] > index) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
 int getEncodingLine(RLE_LineEncoding* encoding, int index) {
     if (encoding->count == 0)
         return -1;
 
-    int cursor = 0;
-    int counter = 0;
-    while (true) {
-        counter += encoding->encodings[cursor];
-        int line = encoding->encodings[cursor + 1];
-        cursor += 2;
+    int runs = encoding->count / 2;
+    if (encoding->indexed < runs)
+        indexEncoding(encoding);
+    int* ends = encoding->runEnds;
 
-        if ((index + 1) <= counter || cursor >= encoding->count) {
-            //                                   ^ reach to the end
-            break;
-        }
+    // the same run as last time, or the next one
+    int run = encoding->cursor;
+    if (run >= runs)
+        run = 0;
+    if (index >= ends[run] && run + 1 < runs && index < ends[run + 1]) {
+        run++;
+    } else if (index >= ends[run] || (run > 0 && index < ends[run - 1])) {
+        run = findRun(ends, runs, index);
     }
 
-    return encoding->encodings[cursor - 1];
+    encoding->cursor = run;
+    return encoding->encodings[run * 2 + 1];
+}
+
+int findEncodingLine(const RLE_LineEncoding* encoding, int index) {
+    if (encoding->indexed == 0)
+        return -1;
+    int run = findRun(encoding->runEnds, encoding->indexed, index);
+    return encoding->encodings[run * 2 + 1];
 }
@@ -26,18 +26,37 @@ typedef enum {
     OP_RETURN, // so this is an uint8_t type
 } OpCode;
 
+// number of opcodes, keep OP_RETURN last
+#define OP_COUNT (OP_RETURN + 1)
+
 // all the line NO. info in the source code
 typedef struct {
     int count;
     int capacity;
     // stored in (times_of_occurrence, line_number)
     int* encodings;
+    // lookup index over the runs above, built on the first lookup and not
+    // saved with the chunk. runEnds[i] is the instruction count up to the
+    // end of run i, so a lookup is a binary search
+    int* runEnds;
+    int indexed; // runs covered by runEnds
+    int indexCapacity;
+    // run of the last lookup, disassembling and tracing look up in order
+    int cursor;
 } RLE_LineEncoding;
 
 void initEncoding(RLE_LineEncoding* encoding);
 void freeEncoding(RLE_LineEncoding* encoding);
 void writeLine(RLE_LineEncoding* encoding, int line);
 int getEncodingLine(RLE_LineEncoding* encoding, int index);
+// the same lookup for a signal handler: it only reads, the cursor stays and
+// nothing is indexed or allocated. the runs not indexed yet aren't searched,
+// -1 when there are none
+int findEncodingLine(const RLE_LineEncoding* encoding, int index);
+void indexEncoding(RLE_LineEncoding* encoding);
+
+// machine code for a chunk, see jit.h
+typedef struct JitCode JitCode;
 
 // code instructions in binary format,
 typedef struct {
@@ -55,6 +74,13 @@ typedef struct {
     //   - the reason is obvious, too keep the code section lean
     // @type {Value[]}
     ValueArray constants;
+    // deepest the value stack gets running this chunk, set by verifyChunk()
+    // -1 until the chunk is verified
+    int maxStack;
+    // the chunk compiled by the jit once it ran often enough, see jit.h.
+    // `runs` counts the runs until then, -1 when the jit can't compile it
+    JitCode* jit;
+    int runs;
 } Chunk;
 
 void initChunk(Chunk* chunk);
@@ -62,5 +88,7 @@ void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 int addConstant(Chunk* chunk, Value value);
 int chunkGetLine(Chunk* chunk, int index);
+// see findEncodingLine()
+int chunkFindLine(const Chunk* chunk, int index);
 
 #endif
\ No newline at end of file
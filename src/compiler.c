@@ -9,18 +9,19 @@
 #include "chunk.h"
 #include "common.h"
 #include "compiler.h"
+#include "number.h"
 #include "object.h"
 #include "scanner.h"
 
-#ifdef DEBUG_PRINT_CODE
-#include "debug.h"
-#endif
-
 typedef struct {
     Token current;
     Token previous;
     bool hadError;
     bool panicMode;
+    // set when compiling a pre-tokenized source, tokens are then read by
+    // index instead of calling scanToken()
+    TokenStream* tokens;
+    int next;
 } Parser;
 
 // the lower the higher of the enum value would be
@@ -38,8 +39,10 @@ typedef enum {
     PREC_PRIMARY
 } Precedence;
 
+typedef struct CompilerContext CompilerContext;
+
 // clang function pointer
-typedef void (*ParseFn)(bool canAssign);
+typedef void (*ParseFn)(CompilerContext* context, bool canAssign);
 
 typedef struct {
     ParseFn prefix;
@@ -60,18 +63,24 @@ struct Compiler {
     int scopeDepth;
 };
 
-Parser parser;
-Compiler* current = nullptr;
-Chunk* compilingChunk;
+// everything a single compilation touches, lives on the caller's stack so
+// several compilations (one per vm) can run at once
+struct CompilerContext {
+    Parser parser;
+    Scanner scanner;
+    Compiler* current;
+    Chunk* compilingChunk;
+    VM* vm; // owns the interned strings
+};
 
-static Chunk* currentChunk() {
-    return compilingChunk;
+static Chunk* currentChunk(CompilerContext* context) {
+    return context->compilingChunk;
 }
 
-static void errorAt(Token* token, const char* message) {
-    if (parser.panicMode)
+static void errorAt(CompilerContext* context, Token* token, const char* message) {
+    if (context->parser.panicMode)
         return;
-    parser.panicMode = true;
+    context->parser.panicMode = true;
     fprintf(stderr, "[line %d] Error", token->line);
 
     if (token->type == TOKEN_EOF) {
@@ -83,251 +92,252 @@ static void errorAt(Token* token, const char* message) {
     }
 
     fprintf(stderr, ": %s\n", message);
-    parser.hadError = true;
+    context->parser.hadError = true;
 }
 
-static void errorAtCurrent(const char* message) {
-    errorAt(&parser.current, message);
+static void errorAtCurrent(CompilerContext* context, const char* message) {
+    errorAt(context, &context->parser.current, message);
 }
 
-static void error(const char* message) {
-    errorAt(&parser.previous, message);
+static void error(CompilerContext* context, const char* message) {
+    errorAt(context, &context->parser.previous, message);
 }
 
-static void advance() {
-    parser.previous = parser.current;
+static Token nextToken(CompilerContext* context) {
+    if (context->parser.tokens != NULL)
+        return streamToken(context->parser.tokens, context->parser.next++);
+    return scanToken(&context->scanner);
+}
+
+static void advance(CompilerContext* context) {
+    context->parser.previous = context->parser.current;
 
     while (true) {
-        parser.current = scanToken();
-        if (parser.current.type != TOKEN_ERROR)
+        context->parser.current = nextToken(context);
+        if (context->parser.current.type != TOKEN_ERROR)
             break;
 
-        errorAtCurrent(parser.current.start);
+        errorAtCurrent(context, context->parser.current.start);
     }
 }
 
-static void consume(TokenType type, const char* message) {
-    if (parser.current.type == type) {
-        advance();
+static void consume(CompilerContext* context, TokenType type, const char* message) {
+    if (context->parser.current.type == type) {
+        advance(context);
         return;
     }
 
-    errorAtCurrent(message);
+    errorAtCurrent(context, message);
 }
 
-static bool check(TokenType type) {
-    return parser.current.type == type;
+static bool check(CompilerContext* context, TokenType type) {
+    return context->parser.current.type == type;
 }
 
-static bool match(TokenType type) {
-    if (!check(type))
+static bool match(CompilerContext* context, TokenType type) {
+    if (!check(context, type))
         return false;
-    advance();
+    advance(context);
     return true;
 }
 
-static void emitByte(uint8_t byte) {
-    writeChunk(currentChunk(), byte, parser.previous.line);
+static void emitByte(CompilerContext* context, uint8_t byte) {
+    writeChunk(currentChunk(context), byte, context->parser.previous.line);
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2) {
-    emitByte(byte1);
-    emitByte(byte2);
+static void emitBytes(CompilerContext* context, uint8_t byte1, uint8_t byte2) {
+    emitByte(context, byte1);
+    emitByte(context, byte2);
 }
 
-static void emitReturn() {
-    emitByte(OP_RETURN);
+static void emitReturn(CompilerContext* context) {
+    emitByte(context, OP_RETURN);
 }
 
-static uint8_t makeConstant(Value value) {
-    int constant = addConstant(currentChunk(), value);
+static uint8_t makeConstant(CompilerContext* context, Value value) {
+    int constant = addConstant(currentChunk(context), value);
     if (constant > UINT8_MAX) {
-        error("Too many constants in one chunk.");
+        error(context, "Too many constants in one chunk.");
         return 0;
     }
     return (uint8_t)constant;
 }
 
 // for types that not able to fit in one Byte
-static void emitConstant(Value value) {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+static void emitConstant(CompilerContext* context, Value value) {
+    emitBytes(context, OP_CONSTANT, makeConstant(context, value));
 }
 
-static void initCompiler(Compiler* compiler) {
+static void initCompiler(CompilerContext* context, Compiler* compiler) {
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
-    current = compiler;
+    context->current = compiler;
 }
 
-static void endCompiler() {
-    emitReturn();
-#ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError) {
-        disassembleChunk(currentChunk(), "code");
-    }
-#endif
+static void endCompiler(CompilerContext* context) {
+    emitReturn(context);
 }
 
-static void beginScope() {
-    current->scopeDepth++;
+static void beginScope(CompilerContext* context) {
+    context->current->scopeDepth++;
 }
 
-static void endScope() {
-    current->scopeDepth--;
+static void endScope(CompilerContext* context) {
+    context->current->scopeDepth--;
 }
 
 // empty declarations
-static void expression();
-static void statement();
-static void declaration();
-static void parsePrecedence(Precedence precedence);
+static void expression(CompilerContext* context);
+static void statement(CompilerContext* context);
+static void declaration(CompilerContext* context);
+static void parsePrecedence(CompilerContext* context, Precedence precedence);
 static ParseRule* getRule(TokenType tokenType);
 
-static uint8_t identifierConstant(Token* name) {
-    return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+static uint8_t identifierConstant(CompilerContext* context, Token* name) {
+    return makeConstant(context, OBJ_VAL(copyString(context->vm, name->start, name->length)));
 }
 
-static void addLocal(Token name) {
-    Local* local = &current->locals[current->localCount++];
+static void addLocal(CompilerContext* context, Token name) {
+    Local* local = &context->current->locals[context->current->localCount++];
     local->name = name;
-    local->depth = current->scopeDepth;
+    local->depth = context->current->scopeDepth;
 }
 
-static void declareVariable() {
-    if (current->scopeDepth == 0)
+static void declareVariable(CompilerContext* context) {
+    if (context->current->scopeDepth == 0)
         return;
 
-    Token* name = &parser.previous;
-    addLocal(*name);
+    Token* name = &context->parser.previous;
+    addLocal(context, *name);
 }
 
-static uint8_t parseVariable(const char* errorMessage) {
-    consume(TOKEN_IDENTIFIER, errorMessage);
+static uint8_t parseVariable(CompilerContext* context, const char* errorMessage) {
+    consume(context, TOKEN_IDENTIFIER, errorMessage);
 
-    declareVariable();
-    if (current->scopeDepth > 0)
+    declareVariable(context);
+    if (context->current->scopeDepth > 0)
         return 0;
 
-    return identifierConstant(&parser.previous);
+    return identifierConstant(context, &context->parser.previous);
 }
 
-static void defineVariable(uint8_t global) {
-    if (current->scopeDepth > 0) {
+static void defineVariable(CompilerContext* context, uint8_t global) {
+    if (context->current->scopeDepth > 0) {
         return;
     }
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitBytes(context, OP_DEFINE_GLOBAL, global);
 }
 
-static void binary(bool canAssign) {
+static void binary(CompilerContext* context, bool canAssign) {
     //  - 10 + b * c
     //       ^ previous
-    TokenType operatorType = parser.previous.type;
+    TokenType operatorType = context->parser.previous.type;
     ParseRule* rule = getRule(operatorType);
     //  - 10 + b * c
     //       ^ precedence == PREC_NONE, so +1 gives PREC_FACTOR
-    parsePrecedence((Precedence)(rule->precedence + 1)); // force left associate for expression
+    parsePrecedence(context, (Precedence)(rule->precedence + 1)); // force left associate for expression
 
     switch (operatorType) {
         case TOKEN_BANG_EQUAL:
-            emitBytes(OP_EQUAL, OP_NOT);
+            emitBytes(context, OP_EQUAL, OP_NOT);
             break;
         case TOKEN_EQUAL_EQUAL:
-            emitByte(OP_EQUAL);
+            emitByte(context, OP_EQUAL);
             break;
         case TOKEN_GREATER:
-            emitByte(OP_GREATER);
+            emitByte(context, OP_GREATER);
             break;
         case TOKEN_GREATER_EQUAL:
-            emitBytes(OP_LESS, OP_NOT);
+            emitBytes(context, OP_LESS, OP_NOT);
             break;
         case TOKEN_LESS:
-            emitByte(OP_LESS);
+            emitByte(context, OP_LESS);
             break;
         case TOKEN_LESS_EQUAL:
-            emitBytes(OP_GREATER, OP_NOT);
+            emitBytes(context, OP_GREATER, OP_NOT);
             break;
         case TOKEN_PLUS:
-            emitByte(OP_ADD);
+            emitByte(context, OP_ADD);
             break;
         case TOKEN_MINUS:
-            emitByte(OP_SUBTRACT);
+            emitByte(context, OP_SUBTRACT);
             break;
         case TOKEN_STAR:
-            emitByte(OP_MULTIPLY);
+            emitByte(context, OP_MULTIPLY);
             break;
         case TOKEN_SLASH:
-            emitByte(OP_DIVIDE);
+            emitByte(context, OP_DIVIDE);
             break;
         default:
             return; // Unreachable
     }
 }
 
-static void literal(bool canAssign) {
-    switch (parser.previous.type) {
+static void literal(CompilerContext* context, bool canAssign) {
+    switch (context->parser.previous.type) {
         case TOKEN_FALSE:
-            emitByte(OP_FALSE);
+            emitByte(context, OP_FALSE);
             break;
         case TOKEN_NIL:
-            emitByte(OP_NIL);
+            emitByte(context, OP_NIL);
             break;
         case TOKEN_TRUE:
-            emitByte(OP_TRUE);
+            emitByte(context, OP_TRUE);
             break;
         default:
             return; // Unreachable
     }
 }
 
-static void expression() {
-    parsePrecedence(PREC_ASSIGNMENT);
+static void expression(CompilerContext* context) {
+    parsePrecedence(context, PREC_ASSIGNMENT);
 }
 
-static void block() {
-    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-        declaration();
+static void block(CompilerContext* context) {
+    while (!check(context, TOKEN_RIGHT_BRACE) && !check(context, TOKEN_EOF)) {
+        declaration(context);
     }
 
-    consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+    consume(context, TOKEN_RIGHT_BRACE, "Expect '}' after block.");
 }
 
-static void varDeclaration() {
-    uint8_t global = parseVariable("Expect variable name.");
+static void varDeclaration(CompilerContext* context) {
+    uint8_t global = parseVariable(context, "Expect variable name.");
 
-    if (match(TOKEN_EQUAL)) {
-        expression();
+    if (match(context, TOKEN_EQUAL)) {
+        expression(context);
     } else {
         // `var a;` will turns into `var a = nil;`
-        emitByte(OP_NIL);
+        emitByte(context, OP_NIL);
     }
 
-    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+    consume(context, TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
 
-    defineVariable(global);
+    defineVariable(context, global);
 }
 
-static void expressionStatement() {
-    expression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+static void expressionStatement(CompilerContext* context) {
+    expression(context);
+    consume(context, TOKEN_SEMICOLON, "Expect ';' after expression.");
     // todo: why discard result here?
-    emitByte(OP_POP);
+    emitByte(context, OP_POP);
 }
 
-static void printStatement() {
-    expression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-    emitByte(OP_PRINT);
+static void printStatement(CompilerContext* context) {
+    expression(context);
+    consume(context, TOKEN_SEMICOLON, "Expect ';' after value.");
+    emitByte(context, OP_PRINT);
 }
 
-static void synchronize() {
-    parser.panicMode = false;
+static void synchronize(CompilerContext* context) {
+    context->parser.panicMode = false;
 
-    while (parser.current.type != TOKEN_EOF) {
+    while (context->parser.current.type != TOKEN_EOF) {
         // these are all points where parser can try recovery from error
-        if (parser.previous.type == TOKEN_SEMICOLON)
+        if (context->parser.previous.type == TOKEN_SEMICOLON)
             return;
 
-        switch (parser.current.type) {
+        switch (context->parser.current.type) {
             case TOKEN_CLASS:
             case TOKEN_FUN:
             case TOKEN_VAR:
@@ -341,79 +351,80 @@ static void synchronize() {
             default:; // do nothing. skipping...
         }
 
-        advance();
+        advance(context);
     }
 }
 
-static void declaration() {
-    if (match(TOKEN_VAR)) {
-        varDeclaration();
+static void declaration(CompilerContext* context) {
+    if (match(context, TOKEN_VAR)) {
+        varDeclaration(context);
     } else {
-        statement();
+        statement(context);
     }
 
-    if (parser.panicMode)
-        synchronize();
+    if (context->parser.panicMode)
+        synchronize(context);
 }
 
-static void statement() {
-    if (match(TOKEN_PRINT)) {
-        printStatement();
-    } else if (match(TOKEN_LEFT_BRACE)) {
-        beginScope();
-        block();
-        endScope();
+static void statement(CompilerContext* context) {
+    if (match(context, TOKEN_PRINT)) {
+        printStatement(context);
+    } else if (match(context, TOKEN_LEFT_BRACE)) {
+        beginScope(context);
+        block(context);
+        endScope(context);
     } else {
-        expressionStatement();
+        expressionStatement(context);
     }
 }
 
-static void grouping(bool canAssign) {
-    expression();
-    consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+static void grouping(CompilerContext* context, bool canAssign) {
+    expression(context);
+    consume(context, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
 }
 
-static void number(bool canAssign) {
-    double value = strtod(parser.previous.start, NULL);
-    emitConstant(NUMBER_VAL(value));
+static void number(CompilerContext* context, bool canAssign) {
+    double value = parseNumber(context->parser.previous.start, context->parser.previous.length);
+    emitConstant(context, NUMBER_VAL(value));
 }
 
-static void string(bool canAssign) {
+static void string(CompilerContext* context, bool canAssign) {
     // no beginning & ending quote ", or ending \0
-    emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+    Token* token = &context->parser.previous;
+    emitConstant(context, OBJ_VAL(copyString(context->vm, token->start + 1, token->length - 2)));
 }
 
-static void namedVariable(Token name, bool canAssign) {
-    uint8_t arg = identifierConstant(&name);
+static void namedVariable(CompilerContext* context, Token name, bool canAssign) {
+    uint8_t arg = identifierConstant(context, &name);
 
-    if (canAssign && match(TOKEN_EQUAL)) {
+    if (canAssign && match(context, TOKEN_EQUAL)) {
         // var a = 3;
         //         ^
         // now match expression, this case 3
-        expression();
-        emitBytes(OP_SET_GLOBAL, arg);
+        expression(context);
+        emitBytes(context, OP_SET_GLOBAL, arg);
     } else {
-        emitBytes(OP_GET_GLOBAL, arg);
+        emitBytes(context, OP_GET_GLOBAL, arg);
     }
 }
 
-static void variable(bool canAssign) {
-    namedVariable(parser.previous, canAssign);
+static void variable(CompilerContext* context, bool canAssign) {
+    namedVariable(context, context->parser.previous, canAssign);
 }
 
-static void unary(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
+static void unary(CompilerContext* context, bool canAssign) {
+    TokenType operatorType = context->parser.previous.type;
 
     // Compile the operand
-    parsePrecedence(PREC_UNARY);
+    parsePrecedence(context, PREC_UNARY);
 
     // Emit the operator instruction
     switch (operatorType) {
         case TOKEN_BANG:
-            emitByte(OP_NOT);
+            emitByte(context, OP_NOT);
             break;
         case TOKEN_MINUS:
-            emitByte(OP_NEGATE);
+            emitByte(context, OP_NEGATE);
             break;
         default:
             return; // Unreachable
@@ -486,31 +497,31 @@ ParseRule rules[] = {
 //  - current op: +
 //  - mem stack [], poped [10, (b*c)]
 //  - mem stack [10 + b*c]
-static void parsePrecedence(Precedence precedence) {
-    advance();
+static void parsePrecedence(CompilerContext* context, Precedence precedence) {
+    advance(context);
     //  - 10 + b * c
     //  -    ^ match number infix rule
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+    ParseFn prefixRule = getRule(context->parser.previous.type)->prefix;
     if (prefixRule == NULL) {
-        error("Expect expression");
+        error(context, "Expect expression");
         return;
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
-    prefixRule(canAssign);
+    prefixRule(context, canAssign);
 
     // - if we are at 10 + b * c
     //                         ^ , variable c has lower precedence
     //                         than any other rule, so it'll just
     //                         stop at while loop
-    while (precedence <= getRule(parser.current.type)->precedence) {
-        advance();
+    while (precedence <= getRule(context->parser.current.type)->precedence) {
+        advance(context);
         //  - 10 + b * c
         //         ^
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
+        ParseFn infixRule = getRule(context->parser.previous.type)->infix;
         //  - 10 + b * c
         //       ^ binary
-        infixRule(canAssign); // no need, but c type system require this
+        infixRule(context, canAssign); // no need, but c type system require this
     }
 
     // say we're parsing
@@ -522,8 +533,8 @@ static void parsePrecedence(Precedence precedence) {
     //    ^ step out of binary function (frame B), we're in frame A,
     //    so canAssign == true, and we also exit while loop due to
     //    `=` sign has precedence of PREC_NONE
-    if (canAssign && match(TOKEN_EQUAL)) {
-        error("Invalid assigment target.");
+    if (canAssign && match(context, TOKEN_EQUAL)) {
+        error(context, "Invalid assigment target.");
     }
 }
 
@@ -536,24 +547,38 @@ static ParseRule* getRule(TokenType type) {
 // like  :[ a b c * +]
 // when paring a * b + c, the output would then be
 // output:[ a b * c +]
-bool compile(const char* source, Chunk* chunk) {
-    initScanner(source);
+static bool compileTokens(CompilerContext* context, Chunk* chunk) {
     Compiler compiler;
-    initCompiler(&compiler);
-    compilingChunk = chunk;
+    initCompiler(context, &compiler);
+    context->compilingChunk = chunk;
 
-    parser.hadError = false;
-    parser.panicMode = false;
+    context->parser.hadError = false;
+    context->parser.panicMode = false;
 
     //  - 10 + b * c
-    advance();
+    advance(context);
     //  - 10 + b * c
     //     ^
 
-    while (!match(TOKEN_EOF)) {
-        declaration();
+    while (!match(context, TOKEN_EOF)) {
+        declaration(context);
     }
 
-    endCompiler();
-    return !parser.hadError;
-}
\ No newline at end of file
+    endCompiler(context);
+    return !context->parser.hadError;
+}
+
+bool compile(VM* vm, const char* source, size_t length, Chunk* chunk) {
+    CompilerContext context = {.vm = vm};
+    initScanner(&context.scanner, source, length);
+    context.parser.tokens = NULL;
+    return compileTokens(&context, chunk);
+}
+
+// same as compile(), but the parser reads from an already tokenized source
+bool compileStream(VM* vm, TokenStream* tokens, Chunk* chunk) {
+    CompilerContext context = {.vm = vm};
+    context.parser.tokens = tokens;
+    context.parser.next = 0;
+    return compileTokens(&context, chunk);
+}
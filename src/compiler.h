@@ -3,8 +3,13 @@
 #define clox_compiler_h
 
 #include "object.h"
+#include "scanner.h"
 #include "vm.h"
 
-bool compile(const char* source, Chunk* chunk);
+// part of the chunk cache key, bump whenever the emitted bytecode changes
+#define COMPILER_VERSION 1
+
+bool compile(VM* vm, const char* source, size_t length, Chunk* chunk);
+bool compileStream(VM* vm, TokenStream* tokens, Chunk* chunk);
 
 #endif
\ No newline at end of file
@@ -2,6 +2,32 @@
 #include "chunk.h"
 #include <stdio.h>
 
+static const char* opcodeNames[] = {
+    [OP_CONSTANT]      = "OP_CONSTANT",
+    [OP_NIL]           = "OP_NIL",
+    [OP_TRUE]          = "OP_TRUE",
+    [OP_FALSE]         = "OP_FALSE",
+    [OP_POP]           = "OP_POP",
+    [OP_GET_GLOBAL]    = "OP_GET_GLOBAL",
+    [OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+    [OP_SET_GLOBAL]    = "OP_SET_GLOBAL",
+    [OP_EQUAL]         = "OP_EQUAL",
+    [OP_GREATER]       = "OP_GREATER",
+    [OP_LESS]          = "OP_LESS",
+    [OP_ADD]           = "OP_ADD",
+    [OP_SUBTRACT]      = "OP_SUBTRACT",
+    [OP_MULTIPLY]      = "OP_MULTIPLY",
+    [OP_DIVIDE]        = "OP_DIVIDE",
+    [OP_NOT]           = "OP_NOT",
+    [OP_NEGATE]        = "OP_NEGATE",
+    [OP_PRINT]         = "OP_PRINT",
+    [OP_RETURN]        = "OP_RETURN",
+};
+
+const char* opcodeName(uint8_t opcode) {
+    return opcode < OP_COUNT ? opcodeNames[opcode] : "OP_UNKNOWN";
+}
+
 void disassembleChunk(Chunk* chunk, char* name) {
     printf("== %s ==\n", name);
     int offset = 0;
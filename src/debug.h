@@ -5,5 +5,6 @@
 
 void disassembleChunk(Chunk* chunk, char* name);
 int disassembleInstruction(Chunk* chunk, int offset);
+const char* opcodeName(uint8_t opcode);
 
 #endif
@@ -0,0 +1,155 @@
+// the dispatch loop, as a template. vm.c includes it once per flavor of
+// the loop, after defining
+//   DISPATCH_NAME       the name of the function
+//   DISPATCH_HOOK(vm)   a statement run before every instruction, empty
+//                       for the plain run()
+//   DISPATCH_SLICED     1 to count instructions against vm->slice and
+//                       yield, 0 for a loop that never does
+// so whatever the hook does costs nothing in the loops without it.
+// no include guard on purpose
+
+static InterpretResult DISPATCH_NAME(VM* vm) {
+#define READ_BYTE() (*vm->ip++)
+#define READ_CONSTANT() (vm->chunk->constants.values[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+// ?: does this `double` break the abstraction for Value type?
+// I would think so, the better way is to use `Value` for type instead of double
+#define BINDARY_OP(valueType, op)                                                                                      \
+    do {                                                                                                               \
+        if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) {                                                      \
+            runtimeError(vm, "Operands must be numbers.");                                                             \
+            return INTERPRET_RUNTIME_ERROR;                                                                            \
+        }                                                                                                              \
+        double b = AS_NUMBER(pop(vm));                                                                                 \
+        double a = AS_NUMBER(pop(vm));                                                                                 \
+        push(vm, valueType(a op b));                                                                                   \
+    } while (false)
+
+#if DISPATCH_SLICED
+    // kept in a local so the check below stays in a register
+    uint64_t budget = vm->slice > 0 ? vm->slice : UINT64_MAX;
+#endif
+
+    for (;;) {
+#if DISPATCH_SLICED
+        // the only preemption point. every instruction counts, as there are
+        // no jumps or calls yet to hang the check on
+        if (budget-- == 0)
+            return INTERPRET_YIELD;
+#endif
+        DISPATCH_HOOK(vm);
+        uint8_t instruction;
+        switch (instruction = READ_BYTE()) {
+            case OP_CONSTANT: {
+                Value constant = READ_CONSTANT();
+                push(vm, constant);
+                break;
+            }
+            case OP_NIL: // nil, like object-c or lua
+                push(vm, NIL_VAL);
+                break;
+            case OP_TRUE:
+                push(vm, BOOL_VAL(true));
+                break;
+            case OP_FALSE:
+                push(vm, BOOL_VAL(false));
+                break;
+            case OP_POP:
+                pop(vm);
+                break;
+            case OP_GET_GLOBAL: {
+                ObjString* name = READ_STRING();
+                Value value;
+                if (!tableGet(&vm->globals, name, &value)) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                push(vm, value);
+                break;
+            }
+            case OP_DEFINE_GLOBAL: {
+                ObjString* name = READ_STRING();
+                // set global variable with data from top of the stack
+                tableSet(&vm->globals, name, peek(vm, 0));
+                // peek first, as when peeking it still has an valid lifetime.
+                pop(vm);
+                break;
+            }
+            case OP_SET_GLOBAL: {
+                ObjString* name = READ_STRING();
+                if (tableSet(&vm->globals, name, peek(vm, 0))) {
+                    // if not already existed in the global variable table, then
+                    // it's error to set this variable.
+                    // clox need global variable to be declared first
+                    tableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_EQUAL: {
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(valuesEqual(a, b)));
+                break;
+            }
+            case OP_GREATER:
+                BINDARY_OP(BOOL_VAL, >);
+                break;
+            case OP_LESS:
+                BINDARY_OP(BOOL_VAL, <);
+                break;
+            case OP_ADD: {
+                if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+                    // string add
+                    concatenate(vm);
+                } else if (IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1))) {
+                    // number add
+                    double b = AS_NUMBER(pop(vm));
+                    double a = AS_NUMBER(pop(vm));
+                    push(vm, NUMBER_VAL(a + b));
+                } else {
+                    runtimeError(vm, "Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_SUBTRACT:
+                BINDARY_OP(NUMBER_VAL, -);
+                break;
+            case OP_MULTIPLY:
+                BINDARY_OP(NUMBER_VAL, *);
+                break;
+            case OP_DIVIDE:
+                BINDARY_OP(NUMBER_VAL, /);
+                break;
+            case OP_NOT:
+                push(vm, BOOL_VAL(isFalsey(pop(vm))));
+                break;
+            case OP_NEGATE:
+                if (!IS_NUMBER(peek(vm, 0))) {
+                    runtimeError(vm, "Operand must be a number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                push(vm, NUMBER_VAL(-(AS_NUMBER(pop(vm)))));
+                break;
+            case OP_PRINT: {
+                writeValue(&vm->output, pop(vm));
+                writeOutput(&vm->output, "\n", 1);
+                break;
+            }
+            case OP_RETURN: {
+                // Exit interpreter.
+                return INTERPRET_OK;
+            }
+        }
+    }
+#undef READ_BYTE
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef BINDARY_OP
+}
+
+#undef DISPATCH_NAME
+#undef DISPATCH_HOOK
+#undef DISPATCH_SLICED
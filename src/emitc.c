@@ -0,0 +1,188 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "emitc.h"
+#include "object.h"
+#include "verify.h"
+
+// a c string literal, anything not plainly printable as an octal escape
+static void writeLiteral(FILE* file, const char* chars, int length) {
+    fputc('"', file);
+    for (int i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c >= ' ' && c < 0x7f && c != '?') {
+            fputc(c, file);
+        } else {
+            fprintf(file, "\\%03o", c);
+        }
+    }
+    fputc('"', file);
+}
+
+// a constant as a c expression, strings are the locals made up front
+static void writeConstant(FILE* file, Chunk* chunk, int index) {
+    Value value = chunk->constants.values[index];
+    switch (value.type) {
+        case VAL_BOOL:
+            fprintf(file, AS_BOOL(value) ? "BOOL_VAL(true)" : "BOOL_VAL(false)");
+            break;
+        case VAL_NIL:
+            fprintf(file, "NIL_VAL");
+            break;
+        case VAL_NUMBER: {
+            double number = AS_NUMBER(value);
+            if (isnan(number)) {
+                fprintf(file, "NUMBER_VAL(NAN)");
+            } else if (isinf(number)) {
+                fprintf(file, "NUMBER_VAL(%sINFINITY)", number < 0 ? "-" : "");
+            } else {
+                // hex floats round trip exactly
+                fprintf(file, "NUMBER_VAL(%a)", number);
+            }
+            break;
+        }
+        case VAL_OBJ:
+            fprintf(file, "k%d", index);
+            break;
+    }
+}
+
+// the statement for one instruction, `depth` is the stack depth before it
+static void writeInstruction(FILE* file, Chunk* chunk, int offset, int depth, int line) {
+    uint8_t instruction = chunk->code[offset];
+    // the two slots on top, `a` below `b`
+    int a = depth - 2;
+    int b = depth - 1;
+
+    fprintf(file, "    ");
+    switch (instruction) {
+        case OP_CONSTANT:
+            fprintf(file, "s%d = ", depth);
+            writeConstant(file, chunk, chunk->code[offset + 1]);
+            fprintf(file, ";");
+            break;
+        case OP_NIL:
+            fprintf(file, "s%d = NIL_VAL;", depth);
+            break;
+        case OP_TRUE:
+            fprintf(file, "s%d = BOOL_VAL(true);", depth);
+            break;
+        case OP_FALSE:
+            fprintf(file, "s%d = BOOL_VAL(false);", depth);
+            break;
+        case OP_POP:
+            fprintf(file, "(void)s%d;", b);
+            break;
+        case OP_GET_GLOBAL: {
+            int name = chunk->code[offset + 1];
+            fprintf(file,
+                    "if (!tableGet(&vm->globals, AS_STRING(k%d), &s%d)) "
+                    "return aotError(vm, %d, \"Undefined variable '%%s'.\", AS_STRING(k%d)->chars);",
+                    name, depth, line, name);
+            break;
+        }
+        case OP_DEFINE_GLOBAL:
+            fprintf(file, "tableSet(&vm->globals, AS_STRING(k%d), s%d);", chunk->code[offset + 1], b);
+            break;
+        case OP_SET_GLOBAL: {
+            // a new key means it wasn't defined, take it out again
+            int name = chunk->code[offset + 1];
+            fprintf(file,
+                    "if (tableSet(&vm->globals, AS_STRING(k%d), s%d)) { tableDelete(&vm->globals, AS_STRING(k%d)); "
+                    "return aotError(vm, %d, \"Undefined variable '%%s'.\", AS_STRING(k%d)->chars); }",
+                    name, b, name, line, name);
+            break;
+        }
+        case OP_EQUAL:
+            fprintf(file, "s%d = BOOL_VAL(valuesEqual(s%d, s%d));", a, a, b);
+            break;
+        case OP_GREATER:
+            fprintf(file, "AOT_BINARY(s%d, s%d, BOOL_VAL, >, %d);", a, b, line);
+            break;
+        case OP_LESS:
+            fprintf(file, "AOT_BINARY(s%d, s%d, BOOL_VAL, <, %d);", a, b, line);
+            break;
+        case OP_ADD:
+            fprintf(file, "AOT_ADD(s%d, s%d, %d);", a, b, line);
+            break;
+        case OP_SUBTRACT:
+            fprintf(file, "AOT_BINARY(s%d, s%d, NUMBER_VAL, -, %d);", a, b, line);
+            break;
+        case OP_MULTIPLY:
+            fprintf(file, "AOT_BINARY(s%d, s%d, NUMBER_VAL, *, %d);", a, b, line);
+            break;
+        case OP_DIVIDE:
+            fprintf(file, "AOT_BINARY(s%d, s%d, NUMBER_VAL, /, %d);", a, b, line);
+            break;
+        case OP_NOT:
+            fprintf(file, "s%d = BOOL_VAL(aotIsFalsey(s%d));", b, b);
+            break;
+        case OP_NEGATE:
+            fprintf(file, "AOT_NEGATE(s%d, %d);", b, line);
+            break;
+        case OP_PRINT:
+            fprintf(file, "aotPrint(vm, s%d);", b);
+            break;
+        case OP_RETURN:
+            fprintf(file, "return INTERPRET_OK;");
+            break;
+    }
+    fprintf(file, " // %s\n", opcodeName(instruction));
+}
+
+bool writeC(Chunk* chunk, const char* name, const char* path) {
+    // the stack slots are locals, verifying gives how many
+    if (chunk->maxStack < 0 && !verifyChunk(chunk))
+        return false;
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "// generated by clox --emit-c from %s, don't edit\n", name);
+    fprintf(file, "#include \"aot.h\"\n\n");
+    fprintf(file, "static InterpretResult script(VM* vm) {\n");
+
+    bool strings = false;
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (!IS_STRING(value))
+            continue;
+        if (!strings)
+            fprintf(file, "    // string constants, interned once\n");
+        strings = true;
+        fprintf(file, "    Value k%d = OBJ_VAL(copyString(vm, ", i);
+        writeLiteral(file, AS_CSTRING(value), AS_STRING(value)->length);
+        fprintf(file, ", %d));\n", AS_STRING(value)->length);
+    }
+    if (chunk->maxStack > 0) {
+        fprintf(file, "    // the value stack\n    Value s0");
+        for (int i = 1; i < chunk->maxStack; i++)
+            fprintf(file, ", s%d", i);
+        fprintf(file, ";\n");
+    }
+
+    int depth = 0;
+    int previousLine = -1;
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int line = chunkGetLine(chunk, offset);
+        if (line != previousLine)
+            fprintf(file, "\n    // line %d\n", line);
+        previousLine = line;
+
+        writeInstruction(file, chunk, offset, depth, line);
+        depth += stackEffect(instruction);
+        offset += instructionLength(instruction);
+        // nothing after it runs
+        if (instruction == OP_RETURN)
+            break;
+    }
+
+    fprintf(file, "}\n\n");
+    fprintf(file, "int main(void) {\n    return aotMain(script);\n}\n");
+    return fclose(file) == 0;
+}
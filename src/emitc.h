@@ -0,0 +1,19 @@
+#ifndef clox_emitc_h
+#define clox_emitc_h
+
+#include "chunk.h"
+#include "common.h"
+
+// clox --emit-c, a chunk written out as a c program. every instruction
+// becomes one statement on local variables standing in for the stack
+// slots, the stack depth at each instruction is known as the code is
+// straight line. the program needs aot.h and libclox.a to build:
+//   clox --emit-c script.lox -o script.c
+//   clang -O2 -Iinclude -Isrc script.c build/libclox.a -lm -o script
+//
+// `name` is only used in the header comment. false when the chunk doesn't
+// verify or `path` can't be written
+
+bool writeC(Chunk* chunk, const char* name, const char* path);
+
+#endif
@@ -0,0 +1,286 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "memory.h"
+#include "object.h"
+#include "value.h"
+#include "verify.h"
+
+#define ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+// FNV-1a, the 64 bits variant of hashString() in object.c
+uint64_t hashBytes(const uint8_t* bytes, size_t length) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+typedef struct {
+    size_t lines;
+    size_t constants;
+    size_t blob;
+    size_t code;
+    size_t size;
+} ImageLayout;
+
+static ImageLayout layoutImage(ImageHeader* header) {
+    ImageLayout layout;
+    layout.lines = ALIGN(sizeof(ImageHeader));
+    layout.constants = ALIGN(layout.lines + sizeof(int) * header->lineCount);
+    layout.blob = ALIGN(layout.constants + sizeof(ImageConstant) * header->constantCount);
+    layout.code = ALIGN(layout.blob + header->blobSize);
+    layout.size = layout.code + header->codeCount;
+    return layout;
+}
+
+bool isImageFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    char magic[4];
+    bool result = fread(magic, sizeof(char), 4, file) == 4 && memcmp(magic, IMAGE_MAGIC, 4) == 0;
+    fclose(file);
+    return result;
+}
+
+bool writeImage(Chunk* chunk, const char* path) {
+    ImageHeader header;
+    memcpy(header.magic, IMAGE_MAGIC, 4);
+    header.version = IMAGE_VERSION;
+    header.byteOrder = IMAGE_BYTE_ORDER;
+    header.codeCount = chunk->count;
+    header.lineCount = chunk->line_encodings.count;
+    header.constantCount = chunk->constants.count;
+
+    // strings are interned, so the same constant is the same ObjString
+    ValueArray* constants = &chunk->constants;
+    header.blobSize = 0;
+    for (int i = 0; i < constants->count; i++) {
+        if (!IS_STRING(constants->values[i]))
+            continue;
+
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = IS_STRING(constants->values[j]) && AS_OBJ(constants->values[j]) == AS_OBJ(constants->values[i]);
+        }
+        if (!seen)
+            header.blobSize += AS_STRING(constants->values[i])->length;
+    }
+
+    ImageLayout layout = layoutImage(&header);
+    uint8_t* bytes = ALLOCATE(uint8_t, layout.size);
+    memset(bytes, 0, layout.size);
+
+    memcpy(bytes + layout.lines, chunk->line_encodings.encodings, sizeof(int) * header.lineCount);
+
+    ImageConstant* imageConstants = (ImageConstant*)(bytes + layout.constants);
+    char* blob = (char*)(bytes + layout.blob);
+    uint32_t blobCount = 0;
+    for (int i = 0; i < constants->count; i++) {
+        Value value = constants->values[i];
+        ImageConstant* constant = &imageConstants[i];
+        constant->type = value.type;
+        constant->length = 0;
+        constant->as.offset = 0;
+
+        switch (value.type) {
+            case VAL_BOOL:
+                constant->as.boolean = AS_BOOL(value);
+                break;
+            case VAL_NIL:
+                break;
+            case VAL_NUMBER:
+                constant->as.number = AS_NUMBER(value);
+                break;
+            case VAL_OBJ: {
+                ObjString* string = AS_STRING(value);
+                constant->length = string->length;
+
+                int previous = 0;
+                while (previous < i && !(IS_OBJ(constants->values[previous]) &&
+                                         AS_OBJ(constants->values[previous]) == AS_OBJ(value))) {
+                    previous++;
+                }
+
+                if (previous < i) {
+                    constant->as.offset = imageConstants[previous].as.offset;
+                } else {
+                    constant->as.offset = blobCount;
+                    memcpy(blob + blobCount, string->chars, string->length);
+                    blobCount += string->length;
+                }
+                break;
+            }
+        }
+    }
+
+    memcpy(bytes + layout.code, chunk->code, chunk->count);
+
+    header.hash = hashBytes(bytes + sizeof(ImageHeader), layout.size - sizeof(ImageHeader));
+    memcpy(bytes, &header, sizeof(ImageHeader));
+
+    // write next to the target and rename, readers never see half an image.
+    // the name is unique, threads of one process may write the same image
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.XXXXXX", path);
+    int fd = mkstemp(tmpPath);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (fd >= 0 && file == NULL) {
+        close(fd);
+        unlink(tmpPath);
+    }
+
+    bool result = file != NULL;
+    if (result) {
+        result = fwrite(bytes, sizeof(uint8_t), layout.size, file) == layout.size;
+        result = fclose(file) == 0 && result;
+        result = result && rename(tmpPath, path) == 0;
+        if (!result)
+            unlink(tmpPath);
+    }
+
+    FREE_ARRAY(uint8_t, bytes, layout.size);
+    return result;
+}
+
+static bool invalidImage(const char* path, const char* reason) {
+    fprintf(stderr, "Invalid image \"%s\": %s.\n", path, reason);
+    return false;
+}
+
+static bool checkImage(const char* path, const uint8_t* bytes, size_t size) {
+    if (size < sizeof(ImageHeader))
+        return invalidImage(path, "truncated header");
+
+    ImageHeader header;
+    memcpy(&header, bytes, sizeof(ImageHeader));
+    if (memcmp(header.magic, IMAGE_MAGIC, 4) != 0)
+        return invalidImage(path, "not a clox image");
+    if (header.version != IMAGE_VERSION)
+        return invalidImage(path, "unsupported version");
+    if (header.byteOrder != IMAGE_BYTE_ORDER)
+        return invalidImage(path, "wrong byte order");
+    if (layoutImage(&header).size != size)
+        return invalidImage(path, "size mismatch");
+    if (hashBytes(bytes + sizeof(ImageHeader), size - sizeof(ImageHeader)) != header.hash)
+        return invalidImage(path, "hash mismatch");
+
+    // (count, line) pairs, the counts covering the code exactly. a lookup
+    // trusts that and doesn't check again
+    const int* lines = (const int*)(bytes + layoutImage(&header).lines);
+    if (header.lineCount % 2 != 0)
+        return invalidImage(path, "bad line table");
+    uint64_t covered = 0;
+    for (uint32_t i = 0; i < header.lineCount; i += 2) {
+        if (lines[i] <= 0)
+            return invalidImage(path, "bad line table");
+        covered += (uint64_t)lines[i];
+    }
+    if (covered != header.codeCount)
+        return invalidImage(path, "bad line table");
+
+    const ImageConstant* constants = (const ImageConstant*)(bytes + layoutImage(&header).constants);
+    for (uint32_t i = 0; i < header.constantCount; i++) {
+        const ImageConstant* constant = &constants[i];
+        if (constant->type > VAL_OBJ)
+            return invalidImage(path, "bad constant");
+        // offset + length could wrap around, the offset comes from the file
+        if (constant->type == VAL_OBJ &&
+            (constant->as.offset > header.blobSize || constant->length > header.blobSize - constant->as.offset))
+            return invalidImage(path, "bad string constant");
+    }
+    return true;
+}
+
+// map the image and point the chunk into it, code and lines are not copied
+bool loadImage(VM* vm, Image* image, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return invalidImage(path, "can't open file");
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        close(fd);
+        return invalidImage(path, "empty file");
+    }
+
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return invalidImage(path, "can't map file");
+
+    uint8_t* bytes = (uint8_t*)mapping;
+    if (!checkImage(path, bytes, info.st_size)) {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    ImageHeader header;
+    memcpy(&header, bytes, sizeof(ImageHeader));
+    ImageLayout layout = layoutImage(&header);
+
+    image->mapping = mapping;
+    image->size = info.st_size;
+
+    // capacity stays 0, nothing may grow these arrays
+    Chunk* chunk = &image->chunk;
+    initChunk(chunk);
+    chunk->code = bytes + layout.code;
+    chunk->count = header.codeCount;
+    chunk->line_encodings.encodings = (int*)(bytes + layout.lines);
+    chunk->line_encodings.count = header.lineCount;
+
+    const ImageConstant* constants = (const ImageConstant*)(bytes + layout.constants);
+    const char* blob = (const char*)(bytes + layout.blob);
+    for (uint32_t i = 0; i < header.constantCount; i++) {
+        const ImageConstant* constant = &constants[i];
+        switch ((ValueType)constant->type) {
+            case VAL_BOOL:
+                writeValueArray(&chunk->constants, BOOL_VAL(constant->as.boolean != 0));
+                break;
+            case VAL_NIL:
+                writeValueArray(&chunk->constants, NIL_VAL);
+                break;
+            case VAL_NUMBER:
+                writeValueArray(&chunk->constants, NUMBER_VAL(constant->as.number));
+                break;
+            case VAL_OBJ:
+                writeValueArray(&chunk->constants,
+                                OBJ_VAL(copyString(vm, blob + constant->as.offset, (int)constant->length)));
+                break;
+        }
+    }
+
+    // the code comes from disk, never run it unchecked
+    if (!verifyChunk(chunk)) {
+        freeImage(image);
+        return invalidImage(path, "bytecode failed verification");
+    }
+
+    return true;
+}
+
+void freeImage(Image* image) {
+    if (image->mapping != NULL) {
+        // the mapping owns these, don't let freeChunk() free them
+        image->chunk.code = NULL;
+        image->chunk.count = 0;
+        image->chunk.line_encodings.encodings = NULL;
+        image->chunk.line_encodings.count = 0;
+        munmap(image->mapping, image->size);
+    }
+
+    freeChunk(&image->chunk);
+    image->mapping = NULL;
+    image->size = 0;
+}
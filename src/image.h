@@ -0,0 +1,57 @@
+#ifndef clox_image_h
+#define clox_image_h
+
+#include "chunk.h"
+#include "common.h"
+
+// a compiled chunk saved to disk (.loxc), so scripts can be run without
+// scanning and compiling them again.
+//
+// layout, every section 8 bytes aligned:
+//   ImageHeader
+//   int[lineCount]                 RLE line table, same as in the chunk
+//   ImageConstant[constantCount]   numbers inline, strings point into the blob
+//   char[blobSize]                 string constants, each one stored once
+//   uint8_t[codeCount]             bytecode
+#define IMAGE_MAGIC "LOXC"
+// bump whenever the opcodes or this layout change
+#define IMAGE_VERSION 1
+// images are native endian, a mismatch just fails to load
+#define IMAGE_BYTE_ORDER 0x0102
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t byteOrder; // IMAGE_BYTE_ORDER as written by the producing machine
+    uint64_t hash;      // FNV-1a over everything after the header
+    uint32_t codeCount;
+    uint32_t lineCount;
+    uint32_t constantCount;
+    uint32_t blobSize;
+} ImageHeader;
+
+typedef struct {
+    uint32_t type; // ValueType
+    uint32_t length;
+    union {
+        double number;
+        uint64_t boolean;
+        uint64_t offset; // into the blob
+    } as;
+} ImageConstant;
+
+// a chunk loaded from an image. the code and line table are used in place
+// from the read-only mapping, only the constants are materialized
+typedef struct {
+    Chunk chunk;
+    void* mapping; // NULL when the chunk is heap allocated
+    size_t size;
+} Image;
+
+uint64_t hashBytes(const uint8_t* bytes, size_t length);
+bool isImageFile(const char* path);
+bool writeImage(Chunk* chunk, const char* path);
+bool loadImage(VM* vm, Image* image, const char* path);
+void freeImage(Image* image);
+
+#endif
@@ -0,0 +1,41 @@
+#include <stdatomic.h>
+
+#include "intern.h"
+#include "table.h"
+#include "vm.h"
+
+// written once by shareStrings(), read-only from then on. the strings live
+// until the process exits
+static Table sharedStrings;
+static Obj* sharedObjects = NULL;
+static atomic_bool frozen = false;
+
+bool shareStrings(VM* vm) {
+    bool expected = false;
+    // a second shareStrings() can't start filling the table either
+    static atomic_bool claimed = false;
+    if (!atomic_compare_exchange_strong(&claimed, &expected, true))
+        return false;
+
+    initTable(&sharedStrings);
+    tableAddAll(&vm->strings, &sharedStrings);
+    // hand the objects over too, so freeVM() leaves them alone
+    sharedObjects = vm->objects;
+    vm->objects = NULL;
+    // and the snapshot mapping restored strings live in
+    vm->snapshot = NULL;
+    freeTable(&vm->strings);
+
+    // release, a vm that sees `frozen` also sees the filled table
+    atomic_store_explicit(&frozen, true, memory_order_release);
+    vm->sharedStrings = true;
+    return true;
+}
+
+bool sharedStringsFrozen() {
+    return atomic_load_explicit(&frozen, memory_order_acquire);
+}
+
+ObjString* findSharedString(const char* chars, int length, uint32_t hash) {
+    return tableFindString(&sharedStrings, chars, length, hash);
+}
@@ -0,0 +1,22 @@
+#ifndef clox_intern_h
+#define clox_intern_h
+
+#include "common.h"
+#include "object.h"
+
+// one process wide set of interned strings, filled once at startup from a
+// seed vm and frozen right after. from then on it's only read, so any vm on
+// any thread looks strings up in it without a lock, before its own
+// vm->strings.
+//
+// a string has to be interned exactly once for `==` on pointers to work,
+// so only vms created after the freeze use the shared set (the seed joins
+// it as it hands over its strings), see VM.sharedStrings
+
+// move every string `vm` interned into the shared set and freeze it.
+// false if it's already frozen
+bool shareStrings(VM* vm);
+bool sharedStringsFrozen();
+ObjString* findSharedString(const char* chars, int length, uint32_t hash);
+
+#endif
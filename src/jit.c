@@ -0,0 +1,670 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+#if defined(__x86_64__)
+
+// the machine code reads and writes Values in place
+static_assert(sizeof(Value) == 16, "a Value is a tag and an 8 byte payload");
+static_assert(sizeof(ValueType) == 4, "the tag is compared as a dword");
+
+// general purpose registers, by encoding
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3 // the stack as it was on entry, slots are addressed off it
+#define RBP 5 // the vm
+#define RSI 6
+#define RDI 7
+
+// xmm0-13 hold numbers of stack slots, 14 and 15 are scratch
+#define JIT_REGISTERS 14
+#define SCRATCH_A 14
+#define SCRATCH_B 15
+
+// condition codes, jcc is 0f 80+cc and setcc 0f 90+cc
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_A 0x7
+#define CC_NP 0xb
+
+// sse2 opcodes, after an f2 (or 66) prefix and 0f
+#define SSE_LOAD 0x10
+#define SSE_STORE 0x11
+#define SSE_ADD 0x58
+#define SSE_MULTIPLY 0x59
+#define SSE_SUBTRACT 0x5c
+#define SSE_DIVIDE 0x5e
+#define SSE_COMPARE 0x2e // ucomisd, 66 prefix
+#define MOVQ_TO_XMM 0x6e
+#define MOVQ_FROM_XMM 0x7e
+
+struct JitCode {
+    void* code;
+    size_t size;
+};
+
+// a jump to code that hands over to the interpreter
+typedef struct {
+    int patch;  // the jump's rel32
+    int offset; // instruction run() continues at
+    int depth;  // stack depth there
+} JitExit;
+
+// a stack slot while compiling
+typedef struct {
+    int reg;  // xmm register with the number in it, -1 when it's in memory
+    int type; // the ValueType when it's known while compiling, -1 when not
+} JitSlot;
+
+typedef struct {
+    Chunk* chunk;
+    uint8_t* code;
+    int count;
+    int capacity;
+    JitSlot* slots;
+    int depth;
+    int owners[JIT_REGISTERS]; // slot in each register, -1 when it's free
+    JitExit* exits;
+    int exitCount;
+    int exitCapacity;
+    bool returned; // compiled OP_RETURN, nothing after it can run
+} Jit;
+
+static void emitByte(Jit* jit, uint8_t byte) {
+    if (jit->capacity < jit->count + 1) {
+        int oldCapacity = jit->capacity;
+        jit->capacity = GROW_CAPACITY(oldCapacity);
+        jit->code = GROW_ARRAY(uint8_t, jit->code, oldCapacity, jit->capacity);
+    }
+    jit->code[jit->count++] = byte;
+}
+
+static void emitBytes(Jit* jit, const uint8_t* bytes, int count) {
+    for (int i = 0; i < count; i++)
+        emitByte(jit, bytes[i]);
+}
+
+static void emit32(Jit* jit, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        emitByte(jit, (uint8_t)(value >> (i * 8)));
+}
+
+static void emit64(Jit* jit, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        emitByte(jit, (uint8_t)(value >> (i * 8)));
+}
+
+// modrm for [base + disp32], base is rbx or rbp so no sib is needed
+static void emitMemory(Jit* jit, int reg, int base, int32_t disp) {
+    emitByte(jit, (uint8_t)(0x80 | (reg & 7) << 3 | base));
+    emit32(jit, (uint32_t)disp);
+}
+
+static int32_t tagOf(int slot) {
+    return slot * (int32_t)sizeof(Value) + (int32_t)offsetof(Value, type);
+}
+
+static int32_t payloadOf(int slot) {
+    return slot * (int32_t)sizeof(Value) + (int32_t)offsetof(Value, as);
+}
+
+// mov rax, imm64
+static void loadImmediate(Jit* jit, uint64_t value) {
+    emitBytes(jit, (uint8_t[]){0x48, 0xb8}, 2);
+    emit64(jit, value);
+}
+
+// mov [base + disp], rax
+static void storeRax(Jit* jit, int base, int32_t disp) {
+    emitBytes(jit, (uint8_t[]){0x48, 0x89}, 2);
+    emitMemory(jit, RAX, base, disp);
+}
+
+// lea reg, [rbx + slot]
+static void loadSlotAddress(Jit* jit, int reg, int slot) {
+    emitBytes(jit, (uint8_t[]){0x48, 0x8d}, 2);
+    emitMemory(jit, reg, RBX, tagOf(slot));
+}
+
+// mov dword [rbx + tag], type
+static void storeTag(Jit* jit, int slot, ValueType type) {
+    emitByte(jit, 0xc7);
+    emitMemory(jit, 0, RBX, tagOf(slot));
+    emit32(jit, type);
+}
+
+// cmp dword [rbx + tag], type
+static void compareTag(Jit* jit, int slot, ValueType type) {
+    emitByte(jit, 0x83);
+    emitMemory(jit, 7, RBX, tagOf(slot));
+    emitByte(jit, (uint8_t)type);
+}
+
+// an sse2 instruction on two xmm registers
+static void sseRegisters(Jit* jit, uint8_t prefix, uint8_t opcode, int reg, int rm) {
+    emitByte(jit, prefix);
+    if (reg >= 8 || rm >= 8)
+        emitByte(jit, (uint8_t)(0x40 | (reg >= 8 ? 0x4 : 0) | (rm >= 8 ? 0x1 : 0)));
+    emitBytes(jit, (uint8_t[]){0x0f, opcode, (uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7))}, 3);
+}
+
+// and on an xmm register and a slot's payload
+static void sseSlot(Jit* jit, uint8_t opcode, int reg, int slot) {
+    emitByte(jit, 0xf2);
+    if (reg >= 8)
+        emitByte(jit, 0x44);
+    emitBytes(jit, (uint8_t[]){0x0f, opcode}, 2);
+    emitMemory(jit, reg, RBX, payloadOf(slot));
+}
+
+// movq between rax and an xmm register
+static void moveBits(Jit* jit, uint8_t opcode, int xmm) {
+    emitBytes(jit, (uint8_t[]){0x66, (uint8_t)(0x48 | (xmm >= 8 ? 0x4 : 0)), 0x0f, opcode,
+                               (uint8_t)(0xc0 | (xmm & 7) << 3)},
+              5);
+}
+
+// jcc rel32, or jmp rel32 for a condition of -1. returns where the rel32
+// goes, see patchJump()
+static int emitJump(Jit* jit, int condition) {
+    if (condition < 0) {
+        emitByte(jit, 0xe9);
+    } else {
+        emitBytes(jit, (uint8_t[]){0x0f, (uint8_t)(0x80 | condition)}, 2);
+    }
+    emit32(jit, 0);
+    return jit->count - 4;
+}
+
+// point a jump at the code emitted next
+static void patchJump(Jit* jit, int patch) {
+    int32_t distance = jit->count - (patch + 4);
+    memcpy(&jit->code[patch], &distance, sizeof(distance));
+}
+
+static void emitCall(Jit* jit, uintptr_t function) {
+    loadImmediate(jit, function);
+    emitBytes(jit, (uint8_t[]){0xff, 0xd0}, 2); // call rax
+}
+
+// vm->ip = code + offset
+static void storeIp(Jit* jit, int offset) {
+    loadImmediate(jit, (uintptr_t)(jit->chunk->code + offset));
+    storeRax(jit, RBP, offsetof(VM, ip));
+}
+
+// leave the code with the vm as run() would have it at `offset`
+static void emitLeave(Jit* jit, int offset, int depth, bool finished) {
+    storeIp(jit, offset);
+    loadSlotAddress(jit, RAX, depth);
+    storeRax(jit, RBP, offsetof(VM, stackTop));
+    emitByte(jit, 0xb8); // mov eax, finished
+    emit32(jit, finished);
+    // add rsp, 8; pop rbp; pop rbx; ret
+    emitBytes(jit, (uint8_t[]){0x48, 0x83, 0xc4, 0x08, 0x5d, 0x5b, 0xc3}, 7);
+}
+
+// hand over to the interpreter at `offset` when `condition` holds, with
+// the stack as it is now. everything has to be in memory by then
+static void exitIf(Jit* jit, int condition, int offset) {
+    if (jit->exitCapacity < jit->exitCount + 1) {
+        int oldCapacity = jit->exitCapacity;
+        jit->exitCapacity = GROW_CAPACITY(oldCapacity);
+        jit->exits = GROW_ARRAY(JitExit, jit->exits, oldCapacity, jit->exitCapacity);
+    }
+    jit->exits[jit->exitCount++] = (JitExit){emitJump(jit, condition), offset, jit->depth};
+}
+
+// write a slot's number out of its register
+static void spill(Jit* jit, int slot) {
+    JitSlot* s = &jit->slots[slot];
+    if (s->reg < 0)
+        return;
+    sseSlot(jit, SSE_STORE, s->reg, slot);
+    storeTag(jit, slot, VAL_NUMBER);
+    jit->owners[s->reg] = -1;
+    s->reg = -1;
+}
+
+// before calls, which may clobber every xmm register, and before leaving
+static void spillAll(Jit* jit) {
+    for (int i = 0; i < jit->depth; i++)
+        spill(jit, i);
+}
+
+static int allocateRegister(Jit* jit) {
+    for (int reg = 0; reg < JIT_REGISTERS; reg++) {
+        if (jit->owners[reg] < 0)
+            return reg;
+    }
+
+    // all taken, the deepest slot is the one needed last
+    int deepest = jit->depth;
+    for (int reg = 0; reg < JIT_REGISTERS; reg++) {
+        if (jit->owners[reg] < deepest)
+            deepest = jit->owners[reg];
+    }
+    int reg = jit->slots[deepest].reg;
+    spill(jit, deepest);
+    return reg;
+}
+
+static void pushSlot(Jit* jit, int type, int reg) {
+    jit->slots[jit->depth] = (JitSlot){reg, type};
+    if (reg >= 0)
+        jit->owners[reg] = jit->depth;
+    jit->depth++;
+}
+
+static void dropSlot(Jit* jit) {
+    jit->depth--;
+    if (jit->slots[jit->depth].reg >= 0)
+        jit->owners[jit->slots[jit->depth].reg] = -1;
+}
+
+// a number slot into a register of its own
+static int toRegister(Jit* jit, int slot) {
+    if (jit->slots[slot].reg < 0) {
+        int reg = allocateRegister(jit);
+        sseSlot(jit, SSE_LOAD, reg, slot);
+        jit->slots[slot].reg = reg;
+        jit->owners[reg] = slot;
+    }
+    return jit->slots[slot].reg;
+}
+
+// the register a number slot is in, loaded into `scratch` when it's in memory
+static int operand(Jit* jit, int slot, int scratch) {
+    if (jit->slots[slot].reg >= 0)
+        return jit->slots[slot].reg;
+    sseSlot(jit, SSE_LOAD, scratch, slot);
+    return scratch;
+}
+
+static bool knownNumbers(Jit* jit, int count) {
+    for (int i = jit->depth - count; i < jit->depth; i++) {
+        if (jit->slots[i].type != VAL_NUMBER)
+            return false;
+    }
+    return true;
+}
+
+// the top `count` slots must be numbers, for the ones not known to be the
+// tag is checked and run() takes over at `offset` when it's wrong
+static void guardNumbers(Jit* jit, int count, int offset) {
+    if (knownNumbers(jit, count))
+        return;
+
+    spillAll(jit);
+    for (int i = jit->depth - count; i < jit->depth; i++) {
+        if (jit->slots[i].type == VAL_NUMBER)
+            continue;
+        compareTag(jit, i, VAL_NUMBER);
+        exitIf(jit, CC_NE, offset);
+    }
+    for (int i = jit->depth - count; i < jit->depth; i++)
+        jit->slots[i].type = VAL_NUMBER;
+}
+
+static void pushConstant(Jit* jit, Value value) {
+    if (IS_NUMBER(value)) {
+        int reg = allocateRegister(jit);
+        uint64_t bits;
+        memcpy(&bits, &AS_NUMBER(value), sizeof(bits));
+        loadImmediate(jit, bits);
+        moveBits(jit, MOVQ_TO_XMM, reg);
+        pushSlot(jit, VAL_NUMBER, reg);
+        return;
+    }
+
+    uint64_t payload = 0;
+    if (IS_BOOL(value))
+        payload = AS_BOOL(value);
+    if (IS_OBJ(value))
+        payload = (uintptr_t)AS_OBJ(value);
+    storeTag(jit, jit->depth, value.type);
+    loadImmediate(jit, payload);
+    storeRax(jit, RBX, payloadOf(jit->depth));
+    pushSlot(jit, value.type, -1);
+}
+
+// the helpers the code calls for what it doesn't do inline. the ones that
+// return false leave everything as it was, run() then does it over and
+// reports the error
+
+static bool jitGetGlobal(VM* vm, ObjString* name, Value* slot) {
+    return tableGet(&vm->globals, name, slot);
+}
+
+static void jitDefineGlobal(VM* vm, ObjString* name, Value* slot) {
+    tableSet(&vm->globals, name, *slot);
+}
+
+static bool jitSetGlobal(VM* vm, ObjString* name, Value* slot) {
+    // a new key means it wasn't defined, take it out again
+    if (tableSet(&vm->globals, name, *slot)) {
+        tableDelete(&vm->globals, name);
+        return false;
+    }
+    return true;
+}
+
+static void jitEqual(Value* slots) {
+    slots[0] = BOOL_VAL(valuesEqual(slots[0], slots[1]));
+}
+
+// the string half of OP_ADD, the numbers are added inline
+static bool jitAdd(VM* vm, Value* slots) {
+    if (!IS_STRING(slots[0]) || !IS_STRING(slots[1]))
+        return false;
+    ObjString* a = AS_STRING(slots[0]);
+    ObjString* b = AS_STRING(slots[1]);
+
+    int length = a->length + b->length;
+    char* chars = ALLOCATE(char, length + 1);
+    memcpy(chars, a->chars, a->length);
+    memcpy(chars + a->length, b->chars, b->length);
+    chars[length] = '\0';
+
+    slots[0] = OBJ_VAL(takeString(vm, chars, length));
+    return true;
+}
+
+static void jitPrint(VM* vm, Value* slot) {
+    writeValue(&vm->output, *slot);
+    writeOutput(&vm->output, "\n", 1);
+}
+
+// call `helper(vm, name, slot)` for a global instruction
+static void callGlobalHelper(Jit* jit, uintptr_t helper, int offset, int slot) {
+    spillAll(jit);
+    // `ip` as run() would have it, for allocations charged to the line
+    storeIp(jit, offset + 2);
+    Value name = jit->chunk->constants.values[jit->chunk->code[offset + 1]];
+    emitBytes(jit, (uint8_t[]){0x48, 0x89, 0xef}, 3); // mov rdi, rbp
+    emitBytes(jit, (uint8_t[]){0x48, 0xbe}, 2);       // mov rsi, name
+    emit64(jit, (uintptr_t)AS_OBJ(name));
+    loadSlotAddress(jit, RDX, slot);
+    emitCall(jit, helper);
+}
+
+static void compileArithmetic(Jit* jit, uint8_t opcode, int offset) {
+    guardNumbers(jit, 2, offset);
+    int a = jit->depth - 2;
+    int b = jit->depth - 1;
+    int left = toRegister(jit, a);
+    int right = operand(jit, b, SCRATCH_B);
+    sseRegisters(jit, 0xf2, opcode, left, right);
+    dropSlot(jit);
+}
+
+// OP_ADD on operands that may be strings
+static void compileAdd(Jit* jit, int offset) {
+    if (knownNumbers(jit, 2)) {
+        compileArithmetic(jit, SSE_ADD, offset);
+        return;
+    }
+
+    spillAll(jit);
+    int a = jit->depth - 2;
+    int b = jit->depth - 1;
+    compareTag(jit, a, VAL_NUMBER);
+    int aNotNumber = emitJump(jit, CC_NE);
+    compareTag(jit, b, VAL_NUMBER);
+    int bNotNumber = emitJump(jit, CC_NE);
+    sseSlot(jit, SSE_LOAD, SCRATCH_A, a);
+    sseSlot(jit, SSE_ADD, SCRATCH_A, b);
+    sseSlot(jit, SSE_STORE, SCRATCH_A, a);
+    int done = emitJump(jit, -1);
+
+    patchJump(jit, aNotNumber);
+    patchJump(jit, bNotNumber);
+    storeIp(jit, offset + 1);
+    emitBytes(jit, (uint8_t[]){0x48, 0x89, 0xef}, 3); // mov rdi, rbp
+    loadSlotAddress(jit, RSI, a);
+    emitCall(jit, (uintptr_t)jitAdd);
+    emitBytes(jit, (uint8_t[]){0x84, 0xc0}, 2); // test al, al
+    exitIf(jit, CC_E, offset);
+
+    patchJump(jit, done);
+    dropSlot(jit);
+    dropSlot(jit);
+    pushSlot(jit, -1, -1);
+}
+
+static void compileComparison(Jit* jit, uint8_t opcode, int offset) {
+    int a = jit->depth - 2;
+    if (opcode == OP_EQUAL && !knownNumbers(jit, 2)) {
+        spillAll(jit);
+        loadSlotAddress(jit, RDI, a);
+        emitCall(jit, (uintptr_t)jitEqual);
+        dropSlot(jit);
+        dropSlot(jit);
+        pushSlot(jit, VAL_BOOL, -1);
+        return;
+    }
+
+    guardNumbers(jit, 2, offset);
+    int left = operand(jit, a, SCRATCH_A);
+    int right = operand(jit, a + 1, SCRATCH_B);
+    if (opcode == OP_LESS) {
+        // a < b as b > a, so unordered (nan) comes out false like in c
+        sseRegisters(jit, 0x66, SSE_COMPARE, right, left);
+    } else {
+        sseRegisters(jit, 0x66, SSE_COMPARE, left, right);
+    }
+    if (opcode == OP_EQUAL) {
+        // equal and ordered
+        emitBytes(jit, (uint8_t[]){0x0f, 0x90 | CC_E, 0xc0, 0x0f, 0x90 | CC_NP, 0xc1, 0x20, 0xc8}, 8);
+    } else {
+        emitBytes(jit, (uint8_t[]){0x0f, 0x90 | CC_A, 0xc0}, 3);
+    }
+    emitBytes(jit, (uint8_t[]){0x0f, 0xb6, 0xc0}, 3); // movzx eax, al
+
+    dropSlot(jit);
+    dropSlot(jit);
+    storeTag(jit, a, VAL_BOOL);
+    storeRax(jit, RBX, payloadOf(a));
+    pushSlot(jit, VAL_BOOL, -1);
+}
+
+static void compileNot(Jit* jit) {
+    int a = jit->depth - 1;
+    int type = jit->slots[a].type;
+    if (type == VAL_NIL || type == VAL_NUMBER || type == VAL_OBJ) {
+        dropSlot(jit);
+        pushConstant(jit, BOOL_VAL(type == VAL_NIL));
+        return;
+    }
+
+    // isFalsey() on the slot in memory, only numbers live in registers
+    emitByte(jit, 0x8b); // mov ecx, tag
+    emitMemory(jit, RCX, RBX, tagOf(a));
+    emitBytes(jit, (uint8_t[]){0x31, 0xc0, 0x83, 0xf9, VAL_NIL, 0x0f, 0x90 | CC_E, 0xc0}, 8);
+    // cmp ecx, VAL_BOOL; jne over the next 10 bytes
+    emitBytes(jit, (uint8_t[]){0x83, 0xf9, VAL_BOOL, 0x75, 10}, 5);
+    emitBytes(jit, (uint8_t[]){0x0f, 0xb6}, 2); // movzx eax, byte payload
+    emitMemory(jit, RAX, RBX, payloadOf(a));
+    emitBytes(jit, (uint8_t[]){0x83, 0xf0, 0x01}, 3); // xor eax, 1
+
+    dropSlot(jit);
+    storeTag(jit, a, VAL_BOOL);
+    storeRax(jit, RBX, payloadOf(a));
+    pushSlot(jit, VAL_BOOL, -1);
+}
+
+static void compileNegate(Jit* jit, int offset) {
+    guardNumbers(jit, 1, offset);
+    int reg = toRegister(jit, jit->depth - 1);
+    moveBits(jit, MOVQ_FROM_XMM, reg);
+    emitBytes(jit, (uint8_t[]){0x48, 0x0f, 0xba, 0xf8, 0x3f}, 5); // btc rax, 63
+    moveBits(jit, MOVQ_TO_XMM, reg);
+}
+
+// the offset of the next instruction, -1 for an opcode the jit doesn't know
+static int compileInstruction(Jit* jit, int offset) {
+    Chunk* chunk = jit->chunk;
+    switch (chunk->code[offset]) {
+        case OP_CONSTANT:
+            pushConstant(jit, chunk->constants.values[chunk->code[offset + 1]]);
+            return offset + 2;
+        case OP_NIL:
+            pushConstant(jit, NIL_VAL);
+            return offset + 1;
+        case OP_TRUE:
+            pushConstant(jit, BOOL_VAL(true));
+            return offset + 1;
+        case OP_FALSE:
+            pushConstant(jit, BOOL_VAL(false));
+            return offset + 1;
+        case OP_POP:
+            dropSlot(jit);
+            return offset + 1;
+        case OP_GET_GLOBAL:
+            callGlobalHelper(jit, (uintptr_t)jitGetGlobal, offset, jit->depth);
+            emitBytes(jit, (uint8_t[]){0x84, 0xc0}, 2); // test al, al
+            exitIf(jit, CC_E, offset);
+            pushSlot(jit, -1, -1);
+            return offset + 2;
+        case OP_DEFINE_GLOBAL:
+            callGlobalHelper(jit, (uintptr_t)jitDefineGlobal, offset, jit->depth - 1);
+            dropSlot(jit);
+            return offset + 2;
+        case OP_SET_GLOBAL:
+            callGlobalHelper(jit, (uintptr_t)jitSetGlobal, offset, jit->depth - 1);
+            emitBytes(jit, (uint8_t[]){0x84, 0xc0}, 2);
+            exitIf(jit, CC_E, offset);
+            return offset + 2;
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+            compileComparison(jit, chunk->code[offset], offset);
+            return offset + 1;
+        case OP_ADD:
+            compileAdd(jit, offset);
+            return offset + 1;
+        case OP_SUBTRACT:
+            compileArithmetic(jit, SSE_SUBTRACT, offset);
+            return offset + 1;
+        case OP_MULTIPLY:
+            compileArithmetic(jit, SSE_MULTIPLY, offset);
+            return offset + 1;
+        case OP_DIVIDE:
+            compileArithmetic(jit, SSE_DIVIDE, offset);
+            return offset + 1;
+        case OP_NOT:
+            compileNot(jit);
+            return offset + 1;
+        case OP_NEGATE:
+            compileNegate(jit, offset);
+            return offset + 1;
+        case OP_PRINT:
+            spillAll(jit);
+            storeIp(jit, offset + 1);
+            emitBytes(jit, (uint8_t[]){0x48, 0x89, 0xef}, 3); // mov rdi, rbp
+            loadSlotAddress(jit, RSI, jit->depth - 1);
+            emitCall(jit, (uintptr_t)jitPrint);
+            dropSlot(jit);
+            return offset + 1;
+        case OP_RETURN:
+            spillAll(jit);
+            emitLeave(jit, offset + 1, jit->depth, true);
+            jit->returned = true;
+            return offset + 1;
+        default:
+            return -1;
+    }
+}
+
+static void freeCompiler(Jit* jit) {
+    FREE_ARRAY(uint8_t, jit->code, jit->capacity);
+    FREE_ARRAY(JitSlot, jit->slots, jit->chunk->maxStack + 1);
+    FREE_ARRAY(JitExit, jit->exits, jit->exitCapacity);
+}
+
+JitCode* compileJit(Chunk* chunk) {
+    // the depths come from verifyChunk()
+    if (chunk->maxStack < 0)
+        return NULL;
+
+    Jit jit = {.chunk = chunk};
+    jit.slots = ALLOCATE(JitSlot, chunk->maxStack + 1);
+    for (int reg = 0; reg < JIT_REGISTERS; reg++)
+        jit.owners[reg] = -1;
+
+    // push rbx; push rbp; sub rsp, 8 (calls need rsp 16 byte aligned);
+    // mov rbp, rdi; mov rbx, [rbp + stackTop]
+    emitBytes(&jit, (uint8_t[]){0x53, 0x55, 0x48, 0x83, 0xec, 0x08, 0x48, 0x89, 0xfd, 0x48, 0x8b}, 11);
+    emitMemory(&jit, RBX, RBP, offsetof(VM, stackTop));
+
+    int offset = 0;
+    while (offset >= 0 && offset < chunk->count && !jit.returned)
+        offset = compileInstruction(&jit, offset);
+    if (!jit.returned) {
+        freeCompiler(&jit);
+        return NULL;
+    }
+
+    // the ways back to the interpreter, out of the way of the code
+    for (int i = 0; i < jit.exitCount; i++) {
+        patchJump(&jit, jit.exits[i].patch);
+        emitLeave(&jit, jit.exits[i].offset, jit.exits[i].depth, false);
+    }
+
+    // written while writable, then only executable
+    void* memory = mmap(NULL, jit.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        freeCompiler(&jit);
+        return NULL;
+    }
+    memcpy(memory, jit.code, jit.count);
+    if (mprotect(memory, jit.count, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, jit.count);
+        freeCompiler(&jit);
+        return NULL;
+    }
+
+    JitCode* code = ALLOCATE(JitCode, 1);
+    code->code = memory;
+    code->size = jit.count;
+    freeCompiler(&jit);
+    return code;
+}
+
+void freeJit(JitCode* code) {
+    if (code == NULL)
+        return;
+    munmap(code->code, code->size);
+    FREE(JitCode, code);
+}
+
+bool runJit(JitCode* code, VM* vm) {
+    bool (*entry)(VM*) = (bool (*)(VM*))code->code;
+    return entry(vm);
+}
+
+#else
+
+JitCode* compileJit(Chunk* chunk) {
+    (void)chunk;
+    return NULL;
+}
+
+void freeJit(JitCode* code) {
+    (void)code;
+}
+
+bool runJit(JitCode* code, VM* vm) {
+    (void)code;
+    (void)vm;
+    return false;
+}
+
+#endif
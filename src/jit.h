@@ -0,0 +1,32 @@
+#ifndef clox_jit_h
+#define clox_jit_h
+
+#include "chunk.h"
+#include "common.h"
+
+// the template jit behind --jit. a verified chunk is translated op by op
+// into x86-64 machine code, every opcode's part of run() written out
+// inline, in an mmap'ed buffer that's made executable once it's complete.
+//
+// there are no jumps in the bytecode yet, so the stack depth at every
+// instruction is known while compiling: slots are addressed off the stack
+// base directly, and numbers stay in xmm registers until something needs
+// them in memory. globals, print, string adds and == on anything but
+// numbers call small c helpers.
+//
+// whatever the code can't handle itself, an operand of the wrong type, an
+// undefined variable, goes back to the interpreter: the registers are
+// written out, `ip` is left at the instruction, and run() carries on from
+// there and reports the error as usual. a chunk with an opcode the jit
+// doesn't know isn't compiled at all.
+//
+// only on x86-64 with the system v abi, elsewhere compileJit() gives NULL
+
+// NULL when the chunk can't be compiled, it then keeps being interpreted
+JitCode* compileJit(Chunk* chunk);
+void freeJit(JitCode* code);
+// run `vm->chunk` from the start. true when it ran to the end, false when
+// it left the rest to the interpreter at `vm->ip`
+bool runJit(JitCode* code, VM* vm);
+
+#endif
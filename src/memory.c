@@ -1,9 +1,20 @@
 #include <stdlib.h>
 
+#include "allocstats.h"
 #include "memory.h"
 #include "vm.h"
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+// the vm whose allocation stats this thread's allocations go to, if any
+static _Thread_local VM* trackedVM = NULL;
+
+void trackAllocations(VM* vm) {
+    trackedVM = vm;
+}
+
+void* reallocate(const char* type, void* pointer, size_t oldSize, size_t newSize) {
+    if (trackedVM != NULL && newSize > oldSize)
+        recordAllocation(trackedVM, type, newSize - oldSize);
+
     if (newSize == 0) {
         free(pointer);
         return NULL;
@@ -25,13 +36,31 @@ static void freeObject(Obj* object) {
         }
     }
 }
-void freeObjects() {
-    Obj* object = vm.objects;
+void freeObjects(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
         freeObject(object);
         object = next;
     }
     // remove last holding pointer
-    vm.objects = NULL;
-}
\ No newline at end of file
+    vm->objects = NULL;
+}
+
+void freeObjectsSince(VM* vm, Obj* mark, Table* keep) {
+    // new objects go in front, so they are the ones before `mark`
+    Obj** link = &vm->objects;
+    while (*link != mark) {
+        Obj* object = *link;
+        Value unused;
+        if (object->type == OBJ_STRING && tableGet(keep, (ObjString*)object, &unused)) {
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+        if (object->type == OBJ_STRING)
+            tableDelete(&vm->strings, (ObjString*)object);
+        freeObject(object);
+    }
+}
@@ -3,20 +3,29 @@
 
 #include "common.h"
 #include "object.h"
+#include "table.h"
 
-#define ALLOCATE(type, count) (type*)reallocate(NULL, 0, sizeof(type) * (count))
+// every allocation passes its c type's name along, for the allocation
+// profiler, see allocstats.h
+#define ALLOCATE(type, count) (type*)reallocate(#type, NULL, 0, sizeof(type) * (count))
 
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
 
-#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
+#define FREE(type, pointer) reallocate(#type, pointer, sizeof(type), 0)
 
 #define GROW_ARRAY(type, pointer, oldCount, newCount)                                                                  \
-    (type*)reallocate(pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
+    (type*)reallocate(#type, pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
 
-#define FREE_ARRAY(type, pointer, count) reallocate(pointer, sizeof(type) * (count), 0)
+#define FREE_ARRAY(type, pointer, count) reallocate(#type, pointer, sizeof(type) * (count), 0)
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+void* reallocate(const char* type, void* pointer, size_t oldSize, size_t newSize);
+// charge what this thread allocates to `vm`'s allocation stats, NULL to stop
+void trackAllocations(VM* vm);
 
-void freeObjects();
+void freeObjects(VM* vm);
+// free the objects allocated since `mark` (the head of `vm->objects` back
+// then) and take them out of the interned strings, except the strings that
+// are keys in `keep`
+void freeObjectsSince(VM* vm, Obj* mark, Table* keep);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+// @see https://www.exploringbinary.com/fast-path-decimal-to-floating-point-conversion/
+// every power of ten up to 1e22 is exact in a double
+static const double powersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// 10^-4 .. 10^5, lower bounds of the decimal exponents %g prints in fixed notation
+static const double exponentBounds[] = {1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5};
+
+// 2^53, the largest integer that a double holds exactly
+#define MAX_EXACT_MANTISSA (1ull << 53)
+
+// 19 decimal digits always fit into an uint64_t
+#define MAX_MANTISSA_DIGITS 19
+
+// strtod() wants a '\0' terminated string and the source doesn't have to be
+static double slowParseNumber(const char* start, int length) {
+    char local[64];
+    char* buffer = length < (int)sizeof(local) ? local : (char*)malloc(length + 1);
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    double value = strtod(buffer, NULL);
+
+    if (buffer != local)
+        free(buffer);
+    return value;
+}
+
+// leading zeros don't count, returns false once the mantissa could overflow
+static bool addDigit(uint64_t* mantissa, int* digits, char c) {
+    int digit = c - '0';
+    if (*digits > 0 || digit != 0)
+        (*digits)++;
+    if (*digits > MAX_MANTISSA_DIGITS)
+        return false;
+
+    *mantissa = *mantissa * 10 + (uint64_t)digit;
+    return true;
+}
+
+// parse a number literal as the scanner matched it, `[0-9]+(\.[0-9]+)?`
+//
+// Clinger's fast path: when the digits fit into a double's mantissa and there
+// are at most 22 of them after the '.', both the mantissa and the power of ten
+// are exact, and the single division is correctly rounded by IEEE 754. that
+// covers pretty much every literal in a real script, the rest goes to strtod()
+double parseNumber(const char* start, int length) {
+    const char* end = start + length;
+    const char* current = start;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fraction = 0;
+
+    for (; current < end && *current != '.'; current++) {
+        if (!addDigit(&mantissa, &digits, *current))
+            return slowParseNumber(start, length);
+    }
+
+    if (current < end) {
+        // skip the '.'
+        for (current++; current < end; current++) {
+            if (!addDigit(&mantissa, &digits, *current))
+                return slowParseNumber(start, length);
+            fraction++;
+        }
+    }
+
+    // c: uint64_t -> double conversion is correctly rounded, so any integer
+    // literal that fits is exact as well
+    if (fraction == 0)
+        return (double)mantissa;
+
+    if (mantissa <= MAX_EXACT_MANTISSA && fraction <= 22)
+        return (double)mantissa / powersOfTen[fraction];
+
+    return slowParseNumber(start, length);
+}
+
+static int writeDigits(char* buffer, uint64_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (int i = 0; i < count; i++) {
+        buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// write `value` exactly the way printf("%g") does, returns the length.
+//
+// %g means 6 significant digits, fixed notation for decimal exponents in
+// [-4, 6) and trailing zeros removed. numbers in that range are rounded to 6
+// digits here directly, anything else (exponent notation, nan, inf) or a
+// rounding that is too close to a tie to decide safely goes through snprintf
+int formatNumber(double value, char* buffer) {
+    double magnitude = fabs(value);
+
+    // integers, the most common case. also catches -0, which %g prints as "-0"
+    if (magnitude < 999999.5 && magnitude == (double)(int64_t)magnitude) {
+        int length = 0;
+        if (signbit(value))
+            buffer[length++] = '-';
+        length += writeDigits(buffer + length, (uint64_t)magnitude);
+        buffer[length] = '\0';
+        return length;
+    }
+
+    if (magnitude >= 1e-4 && magnitude < 999999.5) {
+        // decimal exponent, 10^exponent <= magnitude < 10^(exponent + 1)
+        int exponent = 5;
+        while (exponent > -4 && magnitude < exponentBounds[exponent + 4]) {
+            exponent--;
+        }
+
+        // shift the 6 significant digits in front of the '.'. 10^(5 - exponent)
+        // is exact, so `scaled` is off by half an ulp at most
+        double scaled = magnitude * powersOfTen[5 - exponent];
+        double rounded = floor(scaled + 0.5);
+        double tie = fabs(scaled - floor(scaled) - 0.5);
+
+        if (tie > 1e-6 && rounded >= 100000 && rounded < 1000000) {
+            uint64_t significand = (uint64_t)rounded;
+            int decimals = 5 - exponent;
+            uint64_t unit = (uint64_t)powersOfTen[decimals];
+            uint64_t integer = significand / unit;
+            uint64_t fractional = significand % unit;
+
+            int length = 0;
+            if (value < 0)
+                buffer[length++] = '-';
+            length += writeDigits(buffer + length, integer);
+
+            if (fractional != 0) {
+                // drop the trailing zeros, then pad the leading ones back in
+                while (fractional % 10 == 0) {
+                    fractional /= 10;
+                    decimals--;
+                }
+                buffer[length++] = '.';
+                char digits[20];
+                int count = writeDigits(digits, fractional);
+                for (int i = count; i < decimals; i++) {
+                    buffer[length++] = '0';
+                }
+                memcpy(buffer + length, digits, count);
+                length += count;
+            }
+
+            buffer[length] = '\0';
+            return length;
+        }
+    }
+
+    return snprintf(buffer, NUMBER_BUFFER_SIZE, "%g", value);
+}
@@ -0,0 +1,12 @@
+#ifndef clox_number_h
+#define clox_number_h
+
+#include "common.h"
+
+// big enough for anything formatNumber() writes, incl. the '\0'
+#define NUMBER_BUFFER_SIZE 32
+
+double parseNumber(const char* start, int length);
+int formatNumber(double value, char* buffer);
+
+#endif
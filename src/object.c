@@ -1,32 +1,33 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "intern.h"
 #include "memory.h"
 #include "object.h"
 #include "table.h"
 #include "value.h"
 #include "vm.h"
 
-#define ALLOCATE_OBJ(type, objectType) (type*)allocateObject(sizeof(type), objectType)
+#define ALLOCATE_OBJ(vm, type, objectType) (type*)allocateObject(vm, #type, sizeof(type), objectType)
 
-static Obj* allocateObject(int size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+static Obj* allocateObject(VM* vm, const char* typeName, int size, ObjType type) {
+    Obj* object = (Obj*)reallocate(typeName, NULL, 0, size);
     //                                   ^ the size would be greater than Obj, so it's ok
     object->type = type;
-    object->next = vm.objects;
-    //             ^ need `extern vm` here
-    vm.objects = object;
+    object->next = vm->objects;
+    //             ^ every object belongs to the vm that allocated it
+    vm->objects = object;
     return object;
 }
 
-static ObjString* allocateString(char* chars, int length, uint32_t hash) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-    //                               ^ as u can see here, Obj* can be automatically converted to ObjString. this is
+static ObjString* allocateString(VM* vm, char* chars, int length, uint32_t hash) {
+    ObjString* string = ALLOCATE_OBJ(vm, ObjString, OBJ_STRING);
+    //                                   ^ as u can see here, Obj* can be automatically converted to ObjString. this is
     //                               polymorphism done in c
     string->length = length;
     string->chars = chars;
     string->hash = hash;
-    tableSet(&vm.strings, string, NIL_VAL);
+    tableSet(&vm->strings, string, NIL_VAL);
     return string;
 }
 
@@ -40,28 +41,38 @@ static uint32_t hashString(const char* key, int length) {
     return hash;
 }
 
+// the shared set first, then the vm's own strings
+static ObjString* findInterned(VM* vm, const char* chars, int length, uint32_t hash) {
+    if (vm->sharedStrings) {
+        ObjString* shared = findSharedString(chars, length, hash);
+        if (shared != NULL)
+            return shared;
+    }
+    return tableFindString(&vm->strings, chars, length, hash);
+}
+
 // convert c string to ObjString
-ObjString* takeString(char* chars, int length) {
+ObjString* takeString(VM* vm, char* chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = findInterned(vm, chars, length, hash);
     if (interned != NULL) {
         FREE_ARRAY(char, chars, length + 1);
         return interned;
     }
-    return allocateString(chars, length, hash);
+    return allocateString(vm, chars, length, hash);
 }
 
 // convert c string to ObjString, create a new copy
-ObjString* copyString(const char* chars, int length) {
+ObjString* copyString(VM* vm, const char* chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = findInterned(vm, chars, length, hash);
     if (interned != NULL)
         return interned;
 
     char* heapChars = ALLOCATE(char, length + 1);
     memcpy(heapChars, chars, length);
     heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    return allocateString(vm, heapChars, length, hash);
 }
 
 void printObject(Value value) {
@@ -70,4 +81,12 @@ void printObject(Value value) {
             printf("%s", AS_CSTRING(value));
             break;
     }
-}
\ No newline at end of file
+}
+
+void writeObject(Output* output, Value value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING:
+            writeOutput(output, AS_CSTRING(value), AS_STRING(value)->length);
+            break;
+    }
+}
@@ -38,9 +38,10 @@ struct ObjString {
     uint32_t hash;
 };
 
-ObjString* takeString(char* chars, int length);
-ObjString* copyString(const char* chars, int length);
+ObjString* takeString(VM* vm, char* chars, int length);
+ObjString* copyString(VM* vm, const char* chars, int length);
 void printObject(Value value);
+void writeObject(Output* output, Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
     // c:          ^ can't put this inside a macro defination,
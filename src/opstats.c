@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "memory.h"
+#include "opstats.h"
+
+OpStats* newOpStats() {
+    OpStats* stats = ALLOCATE(OpStats, 1);
+    memset(stats, 0, sizeof(OpStats));
+    stats->timed = -1;
+    resetOpHistory(stats);
+    return stats;
+}
+
+void freeOpStats(OpStats* stats) {
+    FREE(OpStats, stats);
+}
+
+void stopOpStats(OpStats* stats) {
+    if (stats->timed >= 0)
+        stats->cycles[stats->timed] += readCycles() - stats->start;
+    stats->timed = -1;
+}
+
+void resetOpHistory(OpStats* stats) {
+    stats->previous = -1;
+    stats->beforePrevious = -1;
+}
+
+// one opcode sequence in the report, `length` opcodes long
+typedef struct {
+    uint64_t count;
+    uint8_t opcodes[3];
+    int length;
+} Sequence;
+
+static int compareSequences(const void* a, const void* b) {
+    uint64_t countA = ((const Sequence*)a)->count;
+    uint64_t countB = ((const Sequence*)b)->count;
+    // most frequent first
+    return (countA < countB) - (countA > countB);
+}
+
+// every sequence of `length` that ran, most frequent first
+static int listSequences(OpStats* stats, int length, Sequence* sequences) {
+    int count = 0;
+    for (int a = 0; a < OP_COUNT; a++) {
+        if (length == 1 && stats->counts[a] > 0)
+            sequences[count++] = (Sequence){stats->counts[a], {a}, 1};
+        for (int b = 0; b < OP_COUNT && length > 1; b++) {
+            if (length == 2 && stats->bigrams[a][b] > 0)
+                sequences[count++] = (Sequence){stats->bigrams[a][b], {a, b}, 2};
+            for (int c = 0; c < OP_COUNT && length == 3; c++) {
+                if (stats->trigrams[a][b][c] > 0)
+                    sequences[count++] = (Sequence){stats->trigrams[a][b][c], {a, b, c}, 3};
+            }
+        }
+    }
+    qsort(sequences, count, sizeof(Sequence), compareSequences);
+    return count;
+}
+
+static void writeSequencesText(int fd, const char* title, Sequence* sequences, int count) {
+    dprintf(fd, "\ntop %s\n", title);
+    for (int i = 0; i < count && i < OPSTATS_TOP; i++) {
+        dprintf(fd, "%12llu ", (unsigned long long)sequences[i].count);
+        for (int j = 0; j < sequences[i].length; j++)
+            dprintf(fd, " %s", opcodeName(sequences[i].opcodes[j]));
+        dprintf(fd, "\n");
+    }
+}
+
+static void writeSequencesJson(int fd, const char* name, Sequence* sequences, int count) {
+    dprintf(fd, ",\"%s\":[", name);
+    for (int i = 0; i < count && i < OPSTATS_TOP; i++) {
+        dprintf(fd, "%s{\"ops\":[", i == 0 ? "" : ",");
+        for (int j = 0; j < sequences[i].length; j++)
+            dprintf(fd, "%s\"%s\"", j == 0 ? "" : ",", opcodeName(sequences[i].opcodes[j]));
+        dprintf(fd, "],\"count\":%llu}", (unsigned long long)sequences[i].count);
+    }
+    dprintf(fd, "]");
+}
+
+void writeOpStats(OpStats* stats, int fd, bool json) {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    for (int i = 0; i < OP_COUNT; i++) {
+        instructions += stats->counts[i];
+        cycles += stats->cycles[i];
+    }
+
+    // big enough for every trigram
+    int capacity = OP_COUNT * OP_COUNT * OP_COUNT;
+    Sequence* sequences = ALLOCATE(Sequence, capacity);
+
+    int count = listSequences(stats, 1, sequences);
+    if (json) {
+        dprintf(fd, "{\"instructions\":%llu,\"cycles\":%llu,\"opcodes\":[", (unsigned long long)instructions,
+                (unsigned long long)cycles);
+        for (int i = 0; i < count; i++) {
+            uint8_t opcode = sequences[i].opcodes[0];
+            dprintf(fd, "%s{\"op\":\"%s\",\"count\":%llu,\"cycles\":%llu}", i == 0 ? "" : ",", opcodeName(opcode),
+                    (unsigned long long)stats->counts[opcode], (unsigned long long)stats->cycles[opcode]);
+        }
+        dprintf(fd, "]");
+    } else {
+        dprintf(fd, "instructions: %llu, cycles: %llu\n\n", (unsigned long long)instructions,
+                (unsigned long long)cycles);
+        dprintf(fd, "%-18s %12s %7s %14s %10s\n", "opcode", "count", "%", "cycles", "cycles/op");
+        for (int i = 0; i < count; i++) {
+            uint8_t opcode = sequences[i].opcodes[0];
+            dprintf(fd, "%-18s %12llu %6.2f%% %14llu %10.1f\n", opcodeName(opcode),
+                    (unsigned long long)stats->counts[opcode], 100.0 * stats->counts[opcode] / instructions,
+                    (unsigned long long)stats->cycles[opcode], (double)stats->cycles[opcode] / stats->counts[opcode]);
+        }
+    }
+
+    count = listSequences(stats, 2, sequences);
+    if (json) {
+        writeSequencesJson(fd, "bigrams", sequences, count);
+    } else {
+        writeSequencesText(fd, "bigrams", sequences, count);
+    }
+
+    count = listSequences(stats, 3, sequences);
+    if (json) {
+        writeSequencesJson(fd, "trigrams", sequences, count);
+        dprintf(fd, "}\n");
+    } else {
+        writeSequencesText(fd, "trigrams", sequences, count);
+    }
+
+    FREE_ARRAY(Sequence, sequences, capacity);
+}
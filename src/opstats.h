@@ -0,0 +1,72 @@
+#ifndef clox_opstats_h
+#define clox_opstats_h
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "chunk.h"
+#include "common.h"
+
+// execution statistics for --opstats: how often each opcode ran, the cycles
+// spent in it, and which opcodes most often follow each other. only the
+// counting copy of the dispatch loop fills them in (see dispatch.h), the
+// other loops don't know they exist
+
+// n-grams shown in a report
+#define OPSTATS_TOP 10
+
+typedef struct {
+    uint64_t counts[OP_COUNT];
+    uint64_t cycles[OP_COUNT];
+    uint64_t bigrams[OP_COUNT][OP_COUNT];
+    uint64_t trigrams[OP_COUNT][OP_COUNT][OP_COUNT];
+    // the last two opcodes that ran, -1 when there are none yet
+    int previous;
+    int beforePrevious;
+    // the opcode running since `start`, -1 between runs
+    int timed;
+    uint64_t start;
+} OpStats;
+
+OpStats* newOpStats();
+void freeOpStats(OpStats* stats);
+// a run returned or yielded, stop the clock on its last instruction
+void stopOpStats(OpStats* stats);
+// a new chunk starts, its first opcodes don't pair with the last ones
+void resetOpHistory(OpStats* stats);
+// the report, as a table or as json
+void writeOpStats(OpStats* stats, int fd, bool json);
+
+// tsc ticks where there is one, nanoseconds elsewhere
+static inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// the hook of the counting loop, `opcode` is about to run. an opcode's
+// cycles are the time until the next hook, so they include one hook each
+static inline void countInstruction(OpStats* stats, uint8_t opcode) {
+    uint64_t now = readCycles();
+    if (stats->timed >= 0)
+        stats->cycles[stats->timed] += now - stats->start;
+
+    stats->counts[opcode]++;
+    if (stats->previous >= 0) {
+        stats->bigrams[stats->previous][opcode]++;
+        if (stats->beforePrevious >= 0)
+            stats->trigrams[stats->beforePrevious][stats->previous][opcode]++;
+    }
+    stats->beforePrevious = stats->previous;
+    stats->previous = opcode;
+    stats->timed = opcode;
+    stats->start = now;
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "output.h"
+
+void initOutput(Output* output, size_t capacity) {
+    output->count = 0;
+    output->capacity = capacity;
+    output->buffer = ALLOCATE(char, capacity);
+
+    output->type = OUTPUT_FD;
+    output->fd = STDOUT_FILENO;
+    output->write = NULL;
+    output->userdata = NULL;
+
+    output->memory = NULL;
+    output->memoryCount = 0;
+    output->memoryCapacity = 0;
+}
+
+void freeOutput(Output* output) {
+    flushOutput(output);
+    FREE_ARRAY(char, output->buffer, output->capacity);
+    FREE_ARRAY(char, output->memory, output->memoryCapacity);
+    output->buffer = NULL;
+    output->memory = NULL;
+    output->count = 0;
+    output->capacity = 0;
+    output->memoryCount = 0;
+    output->memoryCapacity = 0;
+}
+
+void resizeOutput(Output* output, size_t capacity) {
+    flushOutput(output);
+    output->buffer = GROW_ARRAY(char, output->buffer, output->capacity, capacity);
+    output->capacity = capacity;
+}
+
+// switching sinks flushes what the old one still has pending
+void setOutputFd(Output* output, int fd) {
+    flushOutput(output);
+    output->type = OUTPUT_FD;
+    output->fd = fd;
+}
+
+void setOutputMemory(Output* output) {
+    flushOutput(output);
+    output->type = OUTPUT_MEMORY;
+}
+
+void setOutputCallback(Output* output, OutputWriteFn write, void* userdata) {
+    flushOutput(output);
+    output->type = OUTPUT_CALLBACK;
+    output->write = write;
+    output->userdata = userdata;
+}
+
+// write(2) may write less than asked for, keep going until all is out
+static void writeAll(int fd, struct iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            // nowhere left to report to, drop the output like stdio would
+            return;
+        }
+
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+}
+
+static void appendMemory(Output* output, const char* chars, size_t length) {
+    if (length == 0)
+        return;
+
+    if (output->memoryCapacity < output->memoryCount + length) {
+        size_t oldCapacity = output->memoryCapacity;
+        size_t capacity = GROW_CAPACITY(oldCapacity);
+        while (capacity < output->memoryCount + length) {
+            capacity = GROW_CAPACITY(capacity);
+        }
+        output->memory = GROW_ARRAY(char, output->memory, oldCapacity, capacity);
+        output->memoryCapacity = capacity;
+    }
+
+    memcpy(output->memory + output->memoryCount, chars, length);
+    output->memoryCount += length;
+}
+
+// hand the buffer, followed by `extra`, to the sink as one write
+static void flushWith(Output* output, const char* extra, size_t extraLength) {
+    switch (output->type) {
+        case OUTPUT_FD: {
+            // the disassembler and tracing still go through stdio
+            if (output->fd == STDOUT_FILENO)
+                fflush(stdout);
+
+            struct iovec parts[2] = {
+                {output->buffer, output->count},
+                {(void*)extra, extraLength},
+            };
+            writeAll(output->fd, parts, extraLength > 0 ? 2 : 1);
+            break;
+        }
+        case OUTPUT_MEMORY:
+            appendMemory(output, output->buffer, output->count);
+            appendMemory(output, extra, extraLength);
+            break;
+        case OUTPUT_CALLBACK:
+            if (output->count > 0)
+                output->write(output->userdata, output->buffer, output->count);
+            if (extraLength > 0)
+                output->write(output->userdata, extra, extraLength);
+            break;
+    }
+
+    output->count = 0;
+}
+
+void writeOutput(Output* output, const char* chars, size_t length) {
+    if (output->count + length <= output->capacity) {
+        memcpy(output->buffer + output->count, chars, length);
+        output->count += length;
+        return;
+    }
+
+    if (length < output->capacity) {
+        flushWith(output, NULL, 0);
+        memcpy(output->buffer, chars, length);
+        output->count = length;
+        return;
+    }
+
+    // too big to be buffered at all
+    flushWith(output, chars, length);
+}
+
+void flushOutput(Output* output) {
+    if (output->count > 0)
+        flushWith(output, NULL, 0);
+}
@@ -0,0 +1,45 @@
+#ifndef clox_output_h
+#define clox_output_h
+
+#include "common.h"
+
+// default size of the buffer `print` writes into
+#define OUTPUT_BUFFER_SIZE 8192
+
+typedef enum {
+    OUTPUT_FD,       // write(2) to a file descriptor, stdout by default
+    OUTPUT_MEMORY,   // collect everything in `memory`, for embedding
+    OUTPUT_CALLBACK, // hand every flushed block to a host function
+} OutputSinkType;
+
+typedef void (*OutputWriteFn)(void* userdata, const char* chars, size_t length);
+
+// buffered program output. bytes are only handed to the sink when the
+// buffer is full or on flushOutput(), so a script printing lots of small
+// lines costs a handful of write calls instead of one per line
+typedef struct {
+    char* buffer;
+    size_t count;
+    size_t capacity;
+
+    OutputSinkType type;
+    int fd;
+    OutputWriteFn write;
+    void* userdata;
+
+    // OUTPUT_MEMORY, everything flushed so far
+    char* memory;
+    size_t memoryCount;
+    size_t memoryCapacity;
+} Output;
+
+void initOutput(Output* output, size_t capacity);
+void freeOutput(Output* output);
+void resizeOutput(Output* output, size_t capacity);
+void setOutputFd(Output* output, int fd);
+void setOutputMemory(Output* output);
+void setOutputCallback(Output* output, OutputWriteFn write, void* userdata);
+void writeOutput(Output* output, const char* chars, size_t length);
+void flushOutput(Output* output);
+
+#endif
@@ -0,0 +1,125 @@
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "memory.h"
+#include "profile.h"
+
+// the vm running on this thread, read by the handler
+static _Thread_local VM* sampledVM = NULL;
+
+// one source line per sample, 0 for samples outside of a run. the handler
+// may run on any thread, so slots are claimed atomically
+static int* samples = NULL;
+static atomic_size_t sampleCount = 0;
+static atomic_bool profiling = false;
+static struct sigaction previousAction;
+
+static void takeSample(int signal) {
+    (void)signal;
+    size_t slot = atomic_fetch_add_explicit(&sampleCount, 1, memory_order_relaxed);
+    if (slot >= PROFILE_CAPACITY)
+        return;
+
+    VM* vm = sampledVM;
+    if (vm == NULL) {
+        samples[slot] = 0;
+        return;
+    }
+    // `ip` is already past the opcode being run. chunkGetLine() would move
+    // the chunk's cursor under the interrupted code, and may allocate, the
+    // read-only lookup does neither. interpretChunk() indexed every run
+    int offset = (int)(vm->ip - vm->chunk->code) - 1;
+    int line = chunkFindLine(vm->chunk, offset < 0 ? 0 : offset);
+    samples[slot] = line < 0 ? 0 : line;
+}
+
+bool startProfile(int interval) {
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&profiling, &expected, true))
+        return false;
+
+    if (samples == NULL)
+        samples = ALLOCATE(int, PROFILE_CAPACITY);
+    atomic_store(&sampleCount, 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    // a write() the timer interrupts goes on instead of failing
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previousAction);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &previousAction, NULL);
+        atomic_store(&profiling, false);
+        return false;
+    }
+    return true;
+}
+
+void stopProfile() {
+    if (!atomic_load(&profiling))
+        return;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &previousAction, NULL);
+    atomic_store(&profiling, false);
+}
+
+bool profileRunning() {
+    return atomic_load(&profiling);
+}
+
+static int compareLines(const void* a, const void* b) {
+    int lineA = *(const int*)a;
+    int lineB = *(const int*)b;
+    return (lineA > lineB) - (lineA < lineB);
+}
+
+bool writeProfile(int fd) {
+    size_t count = atomic_load(&sampleCount);
+    if (count > PROFILE_CAPACITY) {
+        fprintf(stderr, "Profile buffer full, %zu samples dropped.\n", count - PROFILE_CAPACITY);
+        count = PROFILE_CAPACITY;
+    }
+    if (count == 0)
+        return true;
+
+    // sorted, every run of equal lines is one stack
+    int* lines = ALLOCATE(int, count);
+    memcpy(lines, samples, sizeof(int) * count);
+    qsort(lines, count, sizeof(int), compareLines);
+
+    bool result = true;
+    for (size_t start = 0, end; start < count && result; start = end) {
+        for (end = start; end < count && lines[end] == lines[start]; end++)
+            ;
+        if (lines[start] == 0) {
+            result = dprintf(fd, "(outside run) %zu\n", end - start) > 0;
+        } else {
+            result = dprintf(fd, "script;line %d %zu\n", lines[start], end - start) > 0;
+        }
+    }
+
+    FREE_ARRAY(int, lines, count);
+    return result;
+}
+
+void enterProfile(VM* vm) {
+    sampledVM = vm;
+}
+
+void leaveProfile() {
+    sampledVM = NULL;
+}
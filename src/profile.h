@@ -0,0 +1,35 @@
+#ifndef clox_profile_h
+#define clox_profile_h
+
+#include "common.h"
+#include "vm.h"
+
+// the sampling profiler behind --profile. a SIGPROF timer interrupts the
+// process every so much cpu time, and the handler notes the source line
+// the interrupted vm is on. the vm only tells it which vm runs on which
+// thread, once per run, the dispatch loop doesn't know about it.
+//
+// the report is in the folded stack format flamegraph tools read, one
+// stack per line followed by its sample count:
+//   script;line 12 57
+// there are no functions yet, so a stack is the script and a line. time
+// spent outside of any run (scanning, compiling) shows up as `(outside run)`
+
+// default sampling interval, in microseconds of cpu time
+#define PROFILE_INTERVAL 1000
+// samples kept, later ones are dropped. 16 minutes of cpu time at 1ms
+#define PROFILE_CAPACITY (1024 * 1024)
+
+// process wide, false if the timer can't be set up or it's running already
+bool startProfile(int interval);
+void stopProfile();
+// whether the timer is running, the jit stays off then
+bool profileRunning();
+// the folded stacks of everything sampled so far
+bool writeProfile(int fd);
+
+// the vm running on this thread, NULL when none is
+void enterProfile(VM* vm);
+void leaveProfile();
+
+#endif
@@ -1,22 +1,59 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "common.h"
+#include "memory.h"
 #include "scanner.h"
 
-typedef struct {
-    // start pointer to source string
-    const char* start;
-    // current pointer to source string
-    const char* current;
-    int line;
-} Scanner;
-
-Scanner scanner;
-
-void initScanner(const char* source) {
-    scanner.start = source;
-    scanner.current = source;
-    scanner.line = 1;
+// simd fast paths, classify a whole block of source bytes per step instead of
+// one char at a time. the scalar code below is still the source of truth, the
+// fast paths only skip over bytes the scalar loops would have skipped anyway.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCANNER_SIMD
+#define BLOCK_SIZE 32
+#define BLOCK_ALL 0xFFFFFFFFu
+typedef __m256i Block;
+#define BLOCK_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define BLOCK_SPLAT(c) _mm256_set1_epi8(c)
+#define BLOCK_EQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define BLOCK_GT(a, b) _mm256_cmpgt_epi8(a, b)
+#define BLOCK_OR(a, b) _mm256_or_si256(a, b)
+#define BLOCK_AND(a, b) _mm256_and_si256(a, b)
+#define BLOCK_MASK(b) ((uint32_t)_mm256_movemask_epi8(b))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCANNER_SIMD
+#define BLOCK_SIZE 16
+#define BLOCK_ALL 0xFFFFu
+typedef __m128i Block;
+#define BLOCK_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define BLOCK_SPLAT(c) _mm_set1_epi8(c)
+#define BLOCK_EQ(a, b) _mm_cmpeq_epi8(a, b)
+#define BLOCK_GT(a, b) _mm_cmpgt_epi8(a, b)
+#define BLOCK_OR(a, b) _mm_or_si128(a, b)
+#define BLOCK_AND(a, b) _mm_and_si128(a, b)
+#define BLOCK_MASK(b) ((uint32_t)_mm_movemask_epi8(b))
+#endif
+
+// error tokens point to one of these instead of the source, so a TokenStream
+// can keep them as an index
+static const char* errorMessages[] = {
+    "Unterminated string.",
+    "Unexpected character.",
+};
+
+typedef enum {
+    ERROR_UNTERMINATED_STRING,
+    ERROR_UNEXPECTED_CHARACTER,
+} ScanError;
+
+// the source doesn't need a '\0' at the end, it may be an mmap'ed file
+void initScanner(Scanner* scanner, const char* source, size_t length) {
+    scanner->start = source;
+    scanner->current = source;
+    scanner->end = source + length;
+    scanner->line = 1;
 }
 
 static bool isAlpha(const char c) {
@@ -27,76 +64,154 @@ static bool isDigit(const char c) {
     return c >= '0' && c <= '9';
 }
 
-static bool isAtEnd() {
-    return *scanner.current == '\0';
-    // return *scanner.current == "\0";
-    //                            ^ double quote is wrong, it would make this type to `char*`
-    //                            which is not same type as left side
+static bool isSpace(const char c) {
+    return c == ' ' || c == '\r' || c == '\t' || c == '\n';
 }
 
-static char advance() {
-    return *scanner.current++;
+static bool isAtEnd(Scanner* scanner) {
+    return scanner->current >= scanner->end;
+    // used to be `*scanner->current == '\0'`, but the source isn't always terminated
 }
 
-static char peek() {
-    return *scanner.current;
+static char advance(Scanner* scanner) {
+    return *scanner->current++;
 }
 
-static char peekNext() {
-    if (isAtEnd())
+// past the end reads as '\0', same as a terminated string would
+static char peek(Scanner* scanner) {
+    if (isAtEnd(scanner))
+        return '\0';
+    return *scanner->current;
+}
+
+static char peekNext(Scanner* scanner) {
+    if (scanner->end - scanner->current < 2)
         return '\0'; // is this cool?
-    return *(scanner.current + 1);
+    return *(scanner->current + 1);
     // c: read next element on pointer
-    // return scanner.current[1];
+    // return scanner->current[1];
     // book use this one, it's more concise but more confusing
 }
 
-static bool match(const char c) {
-    if (isAtEnd())
+static bool match(Scanner* scanner, const char c) {
+    if (isAtEnd(scanner))
         return false;
-    if (*scanner.current != c)
+    if (*scanner->current != c)
         return false;
 
-    scanner.current++;
+    scanner->current++;
     return true;
 }
 
-static Token makeToken(TokenType type) {
+static Token makeToken(Scanner* scanner, TokenType type) {
     Token token;
     token.type = type;
-    token.start = scanner.start;
+    token.start = scanner->start;
     // length in bytes
-    token.length = (int)(scanner.current - scanner.start);
-    token.line = scanner.line;
+    token.length = (int)(scanner->current - scanner->start);
+    token.line = scanner->line;
     return token;
 }
 
-static Token errorToken(const char* message) {
+static Token errorToken(Scanner* scanner, ScanError error) {
     Token token;
     token.type = TOKEN_ERROR;
-    token.start = message;
-    token.length = (int)strlen(message);
-    token.line = scanner.line;
+    token.start = errorMessages[error];
+    token.length = (int)strlen(errorMessages[error]);
+    token.line = scanner->line;
     return token;
 }
 
-static void skipWhitespace() {
+#ifdef SCANNER_SIMD
+typedef enum {
+    CLASS_SPACE,      // ' ' '\r' '\t' '\n'
+    CLASS_NEWLINE,    // '\n'
+    CLASS_IDENTIFIER, // [a-zA-Z_0-9]
+    CLASS_DIGIT,      // [0-9]
+    CLASS_QUOTE,      // '"'
+} CharClass;
+
+// c: signed compare, bytes >= 0x80 are negative so they never fall in range
+static inline Block inRange(Block block, char lo, char hi) {
+    return BLOCK_AND(BLOCK_GT(block, BLOCK_SPLAT(lo - 1)), BLOCK_GT(BLOCK_SPLAT(hi + 1), block));
+}
+
+// bit i is set if byte i of the block belongs to `charClass`
+// always inlined with a constant class, so the switch folds away
+static inline uint32_t classify(Block block, CharClass charClass) {
+    switch (charClass) {
+        case CLASS_SPACE:
+            return BLOCK_MASK(BLOCK_OR(BLOCK_OR(BLOCK_EQ(block, BLOCK_SPLAT(' ')), BLOCK_EQ(block, BLOCK_SPLAT('\n'))),
+                                       BLOCK_OR(BLOCK_EQ(block, BLOCK_SPLAT('\r')), BLOCK_EQ(block, BLOCK_SPLAT('\t')))));
+        case CLASS_NEWLINE:
+            return BLOCK_MASK(BLOCK_EQ(block, BLOCK_SPLAT('\n')));
+        case CLASS_IDENTIFIER:
+            return BLOCK_MASK(BLOCK_OR(BLOCK_OR(inRange(block, 'a', 'z'), inRange(block, 'A', 'Z')),
+                                       BLOCK_OR(inRange(block, '0', '9'), BLOCK_EQ(block, BLOCK_SPLAT('_')))));
+        case CLASS_DIGIT:
+            return BLOCK_MASK(inRange(block, '0', '9'));
+        case CLASS_QUOTE:
+            return BLOCK_MASK(BLOCK_EQ(block, BLOCK_SPLAT('"')));
+    }
+    return 0;
+}
+
+// advance over the run of chars matching (or, with `until`, not matching)
+// `charClass`, a full block at a time. newlines passed over are counted into
+// `scanner->line` when `countLines` is set.
+// stops at the first byte that ends the run, or when less than a block is left
+// and leaves the rest to the scalar loop.
+static inline void skipBlocks(Scanner* scanner, CharClass charClass, bool until, bool countLines) {
+    while (scanner->end - scanner->current >= BLOCK_SIZE) {
+        Block block = BLOCK_LOAD(scanner->current);
+        uint32_t run = classify(block, charClass);
+        if (until)
+            run = ~run & BLOCK_ALL;
+
+        if (run == BLOCK_ALL) {
+            if (countLines)
+                scanner->line += __builtin_popcount(classify(block, CLASS_NEWLINE));
+            scanner->current += BLOCK_SIZE;
+            continue;
+        }
+
+        // length of the run is the number of trailing ones
+        int length = __builtin_ctz(~run);
+        if (countLines && length > 0)
+            scanner->line += __builtin_popcount(classify(block, CLASS_NEWLINE) & ((1u << length) - 1));
+        scanner->current += length;
+        return;
+    }
+}
+#endif
+
+static void skipWhitespace(Scanner* scanner) {
     while (true) {
-        char c = peek(); // this line is problematic if we reached EOF
+#ifdef SCANNER_SIMD
+        // a single space between tokens is the common case, only go
+        // wide for longer runs like indentation and blank lines
+        if (isSpace(peek(scanner)) && isSpace(peekNext(scanner)))
+            skipBlocks(scanner, CLASS_SPACE, false, true);
+#endif
+        char c = peek(scanner); // this line is problematic if we reached EOF
         switch (c) {
             case ' ':
             case '\r':
             case '\t':
-                advance();
+                advance(scanner);
                 break;
             case '\n':
-                scanner.line++;
-                advance();
+                scanner->line++;
+                advance(scanner);
                 break;
             case '/':
-                if (peekNext() == '/') { // comment
-                    while (peek() != '\n' && !isAtEnd())
-                        advance();
+                if (peekNext(scanner) == '/') { // comment
+#ifdef SCANNER_SIMD
+                    // comments never span lines, so only look for the newline
+                    skipBlocks(scanner, CLASS_NEWLINE, true, false);
+#endif
+                    while (peek(scanner) != '\n' && !isAtEnd(scanner))
+                        advance(scanner);
                 } else { // don't consume
                     return;
                 }
@@ -107,8 +222,8 @@ static void skipWhitespace() {
     }
 }
 
-static TokenType checkKeyword(int start, int length, const char* rest, TokenType type) {
-    if (scanner.current - scanner.start == start + length && memcmp(scanner.start + start, rest, length) == 0) {
+static TokenType checkKeyword(Scanner* scanner, int start, int length, const char* rest, TokenType type) {
+    if (scanner->current - scanner->start == start + length && memcmp(scanner->start + start, rest, length) == 0) {
         return type;
     }
 
@@ -119,139 +234,227 @@ static TokenType checkKeyword(int start, int length, const char* rest, TokenType
 // so the author took the simplest way, that is hand written DFA using switch to simulate Trie
 // as for me, since the dataset is simple, I would simply loop the keywords, but that would be a
 // a little dumb isn't it?
-static TokenType identifierType() {
-    switch (scanner.start[0]) { // c: another way saying `*scanner.start`
+static TokenType identifierType(Scanner* scanner) {
+    switch (scanner->start[0]) { // c: another way saying `*scanner->start`
         case 'a':
-            return checkKeyword(1, 2, "nd", TOKEN_AND);
+            return checkKeyword(scanner, 1, 2, "nd", TOKEN_AND);
         case 'c':
-            return checkKeyword(1, 4, "lass", TOKEN_CLASS);
+            return checkKeyword(scanner, 1, 4, "lass", TOKEN_CLASS);
         case 'e':
-            return checkKeyword(1, 3, "les", TOKEN_ELSE);
+            return checkKeyword(scanner, 1, 3, "les", TOKEN_ELSE);
         case 'f':
-            if (scanner.current - scanner.start > 1) { // assert that scanner.start[1] exist
-                switch (scanner.start[1]) {
+            if (scanner->current - scanner->start > 1) { // assert that scanner->start[1] exist
+                switch (scanner->start[1]) {
                     case 'a':
-                        return checkKeyword(2, 3, "lse", TOKEN_FALSE);
+                        return checkKeyword(scanner, 2, 3, "lse", TOKEN_FALSE);
                     case 'o':
-                        return checkKeyword(2, 1, "r", TOKEN_FOR);
+                        return checkKeyword(scanner, 2, 1, "r", TOKEN_FOR);
                     case 'u':
-                        return checkKeyword(2, 1, "n", TOKEN_FUN);
+                        return checkKeyword(scanner, 2, 1, "n", TOKEN_FUN);
                 }
             }
             break;
         case 'i':
-            return checkKeyword(1, 1, "f", TOKEN_IF);
+            return checkKeyword(scanner, 1, 1, "f", TOKEN_IF);
         case 'n':
-            return checkKeyword(1, 2, "il", TOKEN_NIL);
+            return checkKeyword(scanner, 1, 2, "il", TOKEN_NIL);
         case 'o':
-            return checkKeyword(1, 1, "r", TOKEN_OR);
+            return checkKeyword(scanner, 1, 1, "r", TOKEN_OR);
         case 'p':
-            return checkKeyword(1, 4, "rint", TOKEN_PRINT);
+            return checkKeyword(scanner, 1, 4, "rint", TOKEN_PRINT);
         case 'r':
-            return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
+            return checkKeyword(scanner, 1, 5, "eturn", TOKEN_RETURN);
         case 's':
-            return checkKeyword(1, 4, "uper", TOKEN_SUPER);
+            return checkKeyword(scanner, 1, 4, "uper", TOKEN_SUPER);
         case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
+            if (scanner->current - scanner->start > 1) {
+                switch (scanner->start[1]) {
                     case 'h':
-                        return checkKeyword(2, 2, "is", TOKEN_THIS);
+                        return checkKeyword(scanner, 2, 2, "is", TOKEN_THIS);
                     case 'r':
-                        return checkKeyword(2, 2, "ue", TOKEN_TRUE);
+                        return checkKeyword(scanner, 2, 2, "ue", TOKEN_TRUE);
                 }
             }
         case 'v':
-            return checkKeyword(1, 2, "ar", TOKEN_VAR);
+            return checkKeyword(scanner, 1, 2, "ar", TOKEN_VAR);
         case 'w':
-            return checkKeyword(1, 4, "hile", TOKEN_WHILE);
+            return checkKeyword(scanner, 1, 4, "hile", TOKEN_WHILE);
     }
 
     return TOKEN_IDENTIFIER;
 }
 
-static Token identifier() {
-    while (isAlpha(peek()) || isDigit(peek()))
-        advance();
+static Token identifier(Scanner* scanner) {
+#ifdef SCANNER_SIMD
+    skipBlocks(scanner, CLASS_IDENTIFIER, false, false);
+#endif
+    while (isAlpha(peek(scanner)) || isDigit(peek(scanner)))
+        advance(scanner);
 
-    return makeToken(identifierType());
+    return makeToken(scanner, identifierType(scanner));
 }
 
-static Token number() {
-    while (isDigit(peek()))
-        advance();
-
-    if (peek() == '.' && isDigit(peekNext())) {
-        advance();
-        while (isDigit(peek()))
-            advance();
+static Token number(Scanner* scanner) {
+#ifdef SCANNER_SIMD
+    skipBlocks(scanner, CLASS_DIGIT, false, false);
+#endif
+    while (isDigit(peek(scanner)))
+        advance(scanner);
+
+    if (peek(scanner) == '.' && isDigit(peekNext(scanner))) {
+        advance(scanner);
+#ifdef SCANNER_SIMD
+        skipBlocks(scanner, CLASS_DIGIT, false, false);
+#endif
+        while (isDigit(peek(scanner)))
+            advance(scanner);
     }
 
-    return makeToken(TOKEN_NUMBER);
+    return makeToken(scanner, TOKEN_NUMBER);
 }
 
-static Token string() {
-    while (peek() != '"' && !isAtEnd()) {
-        advance();
+static Token string(Scanner* scanner) {
+#ifdef SCANNER_SIMD
+    skipBlocks(scanner, CLASS_QUOTE, true, true);
+#endif
+    while (peek(scanner) != '"' && !isAtEnd(scanner)) {
+        // strings can span lines
+        if (peek(scanner) == '\n')
+            scanner->line++;
+        advance(scanner);
     }
 
-    // isAtEnd would make sure we can safely peek, because in worst case
-    // the current char would be `\0`
-    if (isAtEnd())
-        return errorToken("Unterminated string.");
+    if (isAtEnd(scanner))
+        return errorToken(scanner, ERROR_UNTERMINATED_STRING);
 
     // the closing quote
-    advance();
+    advance(scanner);
 
-    return makeToken(TOKEN_STRING);
+    return makeToken(scanner, TOKEN_STRING);
 }
 
-Token scanToken() {
-    skipWhitespace();
-    scanner.start = scanner.current;
+Token scanToken(Scanner* scanner) {
+    skipWhitespace(scanner);
+    scanner->start = scanner->current;
 
-    if (isAtEnd())
-        return makeToken(TOKEN_EOF);
+    if (isAtEnd(scanner))
+        return makeToken(scanner, TOKEN_EOF);
 
-    char c = advance();
+    char c = advance(scanner);
     if (isAlpha(c))
-        return identifier();
+        return identifier(scanner);
     if (isDigit(c))
-        return number();
+        return number(scanner);
 
     switch (c) {
         case '(':
-            return makeToken(TOKEN_LEFT_PAREN);
+            return makeToken(scanner, TOKEN_LEFT_PAREN);
         case ')':
-            return makeToken(TOKEN_RIGHT_PAREN);
+            return makeToken(scanner, TOKEN_RIGHT_PAREN);
         case '{':
-            return makeToken(TOKEN_LEFT_BRACE);
+            return makeToken(scanner, TOKEN_LEFT_BRACE);
         case '}':
-            return makeToken(TOKEN_RIGHT_BRACE);
+            return makeToken(scanner, TOKEN_RIGHT_BRACE);
         case ';':
-            return makeToken(TOKEN_SEMICOLON);
+            return makeToken(scanner, TOKEN_SEMICOLON);
         case ',':
-            return makeToken(TOKEN_COMMA);
+            return makeToken(scanner, TOKEN_COMMA);
         case '.':
-            return makeToken(TOKEN_DOT);
+            return makeToken(scanner, TOKEN_DOT);
         case '-':
-            return makeToken(TOKEN_MINUS);
+            return makeToken(scanner, TOKEN_MINUS);
         case '+':
-            return makeToken(TOKEN_PLUS);
+            return makeToken(scanner, TOKEN_PLUS);
         case '/':
-            return makeToken(TOKEN_SLASH);
+            return makeToken(scanner, TOKEN_SLASH);
         case '*':
-            return makeToken(TOKEN_STAR);
+            return makeToken(scanner, TOKEN_STAR);
         case '!':
-            return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
         case '=':
-            return makeToken(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
         case '<':
-            return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
         case '>':
-            return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
         case '"':
-            return string();
+            return string(scanner);
+    }
+
+    return errorToken(scanner, ERROR_UNEXPECTED_CHARACTER);
+}
+
+// start TokenStream
+void initTokenStream(TokenStream* stream) {
+    stream->count = 0;
+    stream->capacity = 0;
+    stream->source = NULL;
+    stream->types = NULL;
+    stream->offsets = NULL;
+    stream->lengths = NULL;
+    stream->lines = NULL;
+}
+
+void freeTokenStream(TokenStream* stream) {
+    FREE_ARRAY(uint8_t, stream->types, stream->capacity);
+    FREE_ARRAY(int, stream->offsets, stream->capacity);
+    FREE_ARRAY(int, stream->lengths, stream->capacity);
+    FREE_ARRAY(int, stream->lines, stream->capacity);
+    initTokenStream(stream);
+}
+
+static void writeToken(TokenStream* stream, Token* token) {
+    if (stream->capacity < stream->count + 1) {
+        int oldCapacity = stream->capacity;
+        stream->capacity = GROW_CAPACITY(oldCapacity);
+        stream->types = GROW_ARRAY(uint8_t, stream->types, oldCapacity, stream->capacity);
+        stream->offsets = GROW_ARRAY(int, stream->offsets, oldCapacity, stream->capacity);
+        stream->lengths = GROW_ARRAY(int, stream->lengths, oldCapacity, stream->capacity);
+        stream->lines = GROW_ARRAY(int, stream->lines, oldCapacity, stream->capacity);
+    }
+
+    int offset;
+    if (token->type == TOKEN_ERROR) {
+        offset = token->start == errorMessages[ERROR_UNTERMINATED_STRING] ? ERROR_UNTERMINATED_STRING
+                                                                          : ERROR_UNEXPECTED_CHARACTER;
+    } else {
+        offset = (int)(token->start - stream->source);
     }
 
-    return errorToken("Unexpected character.");
-}
\ No newline at end of file
+    stream->types[stream->count] = (uint8_t)token->type;
+    stream->offsets[stream->count] = offset;
+    stream->lengths[stream->count] = token->length;
+    stream->lines[stream->count] = token->line;
+    stream->count++;
+}
+
+// scan the whole source, the last token is always TOKEN_EOF
+void tokenize(TokenStream* stream, const char* source, size_t length) {
+    stream->source = source;
+    Scanner scanner;
+    initScanner(&scanner, source, length);
+
+    while (true) {
+        Token token = scanToken(&scanner);
+        writeToken(stream, &token);
+        if (token.type == TOKEN_EOF)
+            break;
+    }
+}
+
+// reading past the end keeps returning TOKEN_EOF
+Token streamToken(TokenStream* stream, int index) {
+    if (index >= stream->count)
+        index = stream->count - 1;
+
+    Token token;
+    token.type = (TokenType)stream->types[index];
+    token.length = stream->lengths[index];
+    token.line = stream->lines[index];
+    if (token.type == TOKEN_ERROR) {
+        token.start = errorMessages[stream->offsets[index]];
+    } else {
+        token.start = stream->source + stream->offsets[index];
+    }
+    return token;
+}
@@ -3,6 +3,8 @@
 #ifndef clox_scanner_h
 #define clox_scanner_h
 
+#include "common.h"
+
 // I format enum in this way so I can check which number is which enum
 // by using vim relative line
 typedef enum {
@@ -59,7 +61,35 @@ typedef struct {
     int line;
 } Token;
 
-void initScanner(const char* source);
-Token scanToken();
+typedef struct {
+    // start pointer to source string
+    const char* start;
+    // current pointer to source string
+    const char* current;
+    // one past the last char, simd loads never read beyond this
+    const char* end;
+    int line;
+} Scanner;
+
+// the whole source tokenized up front, one parallel array per Token field.
+// 13 bytes per token instead of a 24 bytes Token, and the parser can look at
+// any token by index without rescanning
+typedef struct {
+    int count;
+    int capacity;
+    const char* source;
+    uint8_t* types; // TokenType[]
+    int* offsets;   // from `source`, for TOKEN_ERROR an index of the error message
+    int* lengths;
+    int* lines;
+} TokenStream;
+
+void initScanner(Scanner* scanner, const char* source, size_t length);
+Token scanToken(Scanner* scanner);
+
+void initTokenStream(TokenStream* stream);
+void freeTokenStream(TokenStream* stream);
+void tokenize(TokenStream* stream, const char* source, size_t length);
+Token streamToken(TokenStream* stream, int index);
 
 #endif
\ No newline at end of file
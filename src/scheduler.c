@@ -0,0 +1,155 @@
+// round robin scheduling of many vms on a few threads, see clox.h.
+// built on the public api only, a yielded run just goes to the back of the
+// queue and whichever thread picks it up next resumes it
+#include <pthread.h>
+
+#include "clox.h"
+#include "common.h"
+#include "memory.h"
+
+typedef struct Task Task;
+struct Task {
+    CloxVM* vm;
+    CloxChunk* chunk;
+    bool started;
+    CloxDoneFn done;
+    void* userdata;
+    Task* next;
+};
+
+struct CloxScheduler {
+    // runnable tasks, FIFO
+    Task* head;
+    Task* tail;
+    int pending; // scheduled and not done yet
+    bool stopping;
+    uint64_t slice;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // a task was queued, or stopping
+    pthread_cond_t idle;  // pending dropped to 0
+
+    int threadCount;
+    pthread_t* threads;
+};
+
+// call with the lock held
+static void append(CloxScheduler* scheduler, Task* task) {
+    task->next = NULL;
+    if (scheduler->tail == NULL) {
+        scheduler->head = task;
+    } else {
+        scheduler->tail->next = task;
+    }
+    scheduler->tail = task;
+    pthread_cond_signal(&scheduler->ready);
+}
+
+static Task* take(CloxScheduler* scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    while (scheduler->head == NULL && !scheduler->stopping)
+        pthread_cond_wait(&scheduler->ready, &scheduler->lock);
+
+    Task* task = scheduler->head;
+    if (task != NULL) {
+        scheduler->head = task->next;
+        if (scheduler->head == NULL)
+            scheduler->tail = NULL;
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return task;
+}
+
+static void* work(void* arg) {
+    CloxScheduler* scheduler = (CloxScheduler*)arg;
+
+    Task* task;
+    while ((task = take(scheduler)) != NULL) {
+        CloxResult result = task->started ? cloxResume(task->vm) : cloxRun(task->vm, task->chunk);
+        task->started = true;
+
+        if (result == CLOX_YIELD) {
+            pthread_mutex_lock(&scheduler->lock);
+            append(scheduler, task);
+            pthread_mutex_unlock(&scheduler->lock);
+            continue;
+        }
+
+        task->done(task->userdata, task->vm, result);
+        FREE(Task, task);
+
+        pthread_mutex_lock(&scheduler->lock);
+        if (--scheduler->pending == 0)
+            pthread_cond_broadcast(&scheduler->idle);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+    return NULL;
+}
+
+// wake the threads so they see `stopping`, join the first `started` of
+// them and free the scheduler
+static void stopScheduler(CloxScheduler* scheduler, int started) {
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = true;
+    pthread_cond_broadcast(&scheduler->ready);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(scheduler->threads[i], NULL);
+
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->ready);
+    pthread_cond_destroy(&scheduler->idle);
+    FREE_ARRAY(pthread_t, scheduler->threads, scheduler->threadCount);
+    FREE(CloxScheduler, scheduler);
+}
+
+CloxScheduler* cloxNewScheduler(int threads, uint64_t slice) {
+    CloxScheduler* scheduler = ALLOCATE(CloxScheduler, 1);
+    scheduler->head = NULL;
+    scheduler->tail = NULL;
+    scheduler->pending = 0;
+    scheduler->stopping = false;
+    scheduler->slice = slice;
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->ready, NULL);
+    pthread_cond_init(&scheduler->idle, NULL);
+
+    scheduler->threadCount = threads;
+    scheduler->threads = ALLOCATE(pthread_t, threads);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&scheduler->threads[i], NULL, work, scheduler) != 0) {
+            // nothing was scheduled yet, the ones running just stop
+            stopScheduler(scheduler, i);
+            return NULL;
+        }
+    }
+    return scheduler;
+}
+
+void cloxSchedule(CloxScheduler* scheduler, CloxVM* vm, CloxChunk* chunk, CloxDoneFn done, void* userdata) {
+    Task* task = ALLOCATE(Task, 1);
+    task->vm = vm;
+    task->chunk = chunk;
+    task->started = false;
+    task->done = done;
+    task->userdata = userdata;
+    cloxSetSlice(vm, scheduler->slice);
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->pending++;
+    append(scheduler, task);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void cloxWaitScheduler(CloxScheduler* scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    while (scheduler->pending > 0)
+        pthread_cond_wait(&scheduler->idle, &scheduler->lock);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void cloxFreeScheduler(CloxScheduler* scheduler) {
+    cloxWaitScheduler(scheduler);
+    stopScheduler(scheduler, scheduler->threadCount);
+}
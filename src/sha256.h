@@ -0,0 +1,19 @@
+#ifndef clox_sha256_h
+#define clox_sha256_h
+
+#include "common.h"
+
+#define SHA256_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length; // bytes hashed so far
+    uint8_t block[64];
+    size_t blockCount; // bytes waiting in `block`
+} Sha256;
+
+void initSha256(Sha256* sha);
+void updateSha256(Sha256* sha, const void* data, size_t length);
+void finishSha256(Sha256* sha, uint8_t digest[SHA256_SIZE]);
+
+#endif
@@ -0,0 +1,294 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "intern.h"
+#include "memory.h"
+#include "object.h"
+#include "snapshot.h"
+#include "table.h"
+
+#define ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+typedef struct {
+    size_t strings;
+    size_t internTable;
+    size_t globalTable;
+    size_t blob;
+    size_t size;
+} SnapshotLayout;
+
+static SnapshotLayout layoutSnapshot(SnapshotHeader* header) {
+    SnapshotLayout layout;
+    layout.strings = ALIGN(sizeof(SnapshotHeader));
+    layout.internTable = ALIGN(layout.strings + sizeof(ObjString) * (size_t)header->stringCount);
+    layout.globalTable = ALIGN(layout.internTable + sizeof(Entry) * (size_t)header->stringsCapacity);
+    layout.blob = ALIGN(layout.globalTable + sizeof(Entry) * (size_t)header->globalsCapacity);
+    layout.size = layout.blob + header->blobSize;
+    return layout;
+}
+
+// pointers in the file are `index + 1` into the string section
+static void* indexOf(Table* indices, ObjString* string) {
+    Value index;
+    if (string == NULL || !tableGet(indices, string, &index))
+        return NULL;
+    return (void*)(uintptr_t)(AS_NUMBER(index) + 1);
+}
+
+static void addString(Table* indices, SnapshotHeader* header, ObjString* string) {
+    Value index;
+    if (tableGet(indices, string, &index))
+        return;
+    tableSet(indices, string, NUMBER_VAL(header->stringCount++));
+    header->blobSize += string->length + 1;
+}
+
+// in the order of their indices
+static ObjString** listStrings(Table* indices, uint32_t count) {
+    ObjString** strings = ALLOCATE(ObjString*, count);
+    for (int i = 0; i < indices->capacity; i++) {
+        Entry* entry = &indices->entries[i];
+        if (entry->key != NULL)
+            strings[(uint32_t)AS_NUMBER(entry->value)] = entry->key;
+    }
+    return strings;
+}
+
+// field by field into zeroed memory, so padding doesn't leak into the file
+static void writeEntries(Table* table, Table* indices, Entry* entries) {
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        entries[i].key = (ObjString*)indexOf(indices, entry->key);
+        entries[i].value.type = entry->value.type;
+        if (IS_OBJ(entry->value)) {
+            entries[i].value.as.obj = (Obj*)indexOf(indices, (ObjString*)AS_OBJ(entry->value));
+        } else if (IS_BOOL(entry->value)) {
+            entries[i].value.as.boolean = AS_BOOL(entry->value);
+        } else {
+            entries[i].value.as.number = AS_NUMBER(entry->value);
+        }
+    }
+}
+
+bool writeSnapshot(VM* vm, const char* path) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = IMAGE_BYTE_ORDER;
+    header.stringSize = sizeof(ObjString);
+    header.entrySize = sizeof(Entry);
+    header.stringsCapacity = vm->strings.capacity;
+    header.stringsCount = vm->strings.count;
+    header.globalsCapacity = vm->globals.capacity;
+    header.globalsCount = vm->globals.count;
+
+    // every string is interned, so vm->strings has them all, but for the
+    // ones in the shared set
+    Table indices;
+    initTable(&indices);
+    for (int i = 0; i < vm->strings.capacity; i++) {
+        if (vm->strings.entries[i].key != NULL)
+            addString(&indices, &header, vm->strings.entries[i].key);
+    }
+    header.internedCount = header.stringCount;
+    for (int i = 0; i < vm->globals.capacity; i++) {
+        Entry* entry = &vm->globals.entries[i];
+        if (entry->key == NULL)
+            continue;
+        addString(&indices, &header, entry->key);
+        if (IS_STRING(entry->value))
+            addString(&indices, &header, AS_STRING(entry->value));
+    }
+
+    SnapshotLayout layout = layoutSnapshot(&header);
+    uint8_t* bytes = ALLOCATE(uint8_t, layout.size);
+    memset(bytes, 0, layout.size);
+
+    ObjString* strings = (ObjString*)(bytes + layout.strings);
+    char* blob = (char*)(bytes + layout.blob);
+    ObjString** originals = listStrings(&indices, header.stringCount);
+    uint32_t blobCount = 0;
+    for (uint32_t i = 0; i < header.stringCount; i++) {
+        ObjString* string = originals[i];
+        ObjString* saved = &strings[i];
+        saved->obj.type = OBJ_STRING;
+        saved->length = string->length;
+        saved->hash = string->hash;
+        saved->chars = (char*)(uintptr_t)blobCount;
+        memcpy(blob + blobCount, string->chars, string->length + 1);
+        blobCount += string->length + 1;
+    }
+    FREE_ARRAY(ObjString*, originals, header.stringCount);
+
+    writeEntries(&vm->strings, &indices, (Entry*)(bytes + layout.internTable));
+    writeEntries(&vm->globals, &indices, (Entry*)(bytes + layout.globalTable));
+    freeTable(&indices);
+
+    header.hash = hashBytes(bytes + sizeof(SnapshotHeader), layout.size - sizeof(SnapshotHeader));
+    memcpy(bytes, &header, sizeof(SnapshotHeader));
+
+    // write next to the target and rename, like writeImage()
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, (int)getpid());
+
+    FILE* file = fopen(tmpPath, "wb");
+    bool result = file != NULL;
+    if (result) {
+        result = fwrite(bytes, sizeof(uint8_t), layout.size, file) == layout.size;
+        result = fclose(file) == 0 && result;
+        result = result && rename(tmpPath, path) == 0;
+        if (!result)
+            unlink(tmpPath);
+    }
+
+    FREE_ARRAY(uint8_t, bytes, layout.size);
+    return result;
+}
+
+static bool invalidSnapshot(const char* path, const char* reason) {
+    fprintf(stderr, "Invalid snapshot \"%s\": %s.\n", path, reason);
+    return false;
+}
+
+static bool checkSnapshot(const char* path, const uint8_t* bytes, size_t size) {
+    if (size < sizeof(SnapshotHeader))
+        return invalidSnapshot(path, "truncated header");
+
+    SnapshotHeader header;
+    memcpy(&header, bytes, sizeof(SnapshotHeader));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0)
+        return invalidSnapshot(path, "not a clox snapshot");
+    if (header.version != SNAPSHOT_VERSION)
+        return invalidSnapshot(path, "unsupported version");
+    if (header.byteOrder != IMAGE_BYTE_ORDER || header.stringSize != sizeof(ObjString) ||
+        header.entrySize != sizeof(Entry))
+        return invalidSnapshot(path, "written by a different build");
+    if (header.internedCount > header.stringCount)
+        return invalidSnapshot(path, "bad string count");
+    if (layoutSnapshot(&header).size != size)
+        return invalidSnapshot(path, "size mismatch");
+    if (hashBytes(bytes + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) != header.hash)
+        return invalidSnapshot(path, "hash mismatch");
+    return true;
+}
+
+// turn `index + 1` back into a pointer, false if it's out of range
+static bool fixString(ObjString** strings, uint32_t count, ObjString** pointer) {
+    uintptr_t index = (uintptr_t)*pointer;
+    if (index > count)
+        return false;
+    *pointer = index == 0 ? NULL : strings[index - 1];
+    return true;
+}
+
+// copy a table out of the mapping, it has to stay growable
+static bool restoreTable(Table* table, const Entry* saved, uint32_t capacity, uint32_t count, ObjString** strings,
+                         uint32_t stringCount) {
+    freeTable(table);
+    if (capacity == 0)
+        return true;
+
+    Entry* entries = ALLOCATE(Entry, capacity);
+    memcpy(entries, saved, sizeof(Entry) * capacity);
+    table->entries = entries;
+    table->capacity = (int)capacity;
+    table->count = (int)count;
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (!fixString(strings, stringCount, &entries[i].key) || entries[i].value.type > VAL_OBJ)
+            return false;
+        if (!IS_OBJ(entries[i].value))
+            continue;
+        if (!fixString(strings, stringCount, (ObjString**)&entries[i].value.as.obj) || AS_OBJ(entries[i].value) == NULL)
+            return false;
+    }
+    return true;
+}
+
+bool loadSnapshot(VM* vm, const char* path) {
+    if (vm->snapshot != NULL)
+        return invalidSnapshot(path, "the vm already has a snapshot");
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return invalidSnapshot(path, "can't open file");
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        close(fd);
+        return invalidSnapshot(path, "empty file");
+    }
+
+    // private and writable for the fix ups, made read-only once they're done
+    void* mapping = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return invalidSnapshot(path, "can't map file");
+
+    uint8_t* bytes = (uint8_t*)mapping;
+    if (!checkSnapshot(path, bytes, info.st_size)) {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, bytes, sizeof(SnapshotHeader));
+    SnapshotLayout layout = layoutSnapshot(&header);
+
+    ObjString* strings = (ObjString*)(bytes + layout.strings);
+    char* blob = (char*)(bytes + layout.blob);
+    bool valid = true;
+    for (uint32_t i = 0; i < header.stringCount && valid; i++) {
+        ObjString* string = &strings[i];
+        uintptr_t offset = (uintptr_t)string->chars;
+        // the offset comes from the file, offset + length could wrap around
+        valid = string->obj.type == OBJ_STRING && string->length >= 0 && offset < header.blobSize &&
+                (size_t)string->length < header.blobSize - offset && blob[offset + string->length] == '\0';
+        // not in vm->objects, the mapping owns them
+        string->obj.next = NULL;
+        string->chars = blob + offset;
+    }
+
+    // what a pointer in the file turns into. strings the shared set already
+    // has are used from there, so each string stays interned once
+    ObjString** fixed = ALLOCATE(ObjString*, header.stringCount);
+    for (uint32_t i = 0; i < header.stringCount; i++) {
+        ObjString* string = &strings[i];
+        fixed[i] = NULL;
+        if (valid && vm->sharedStrings)
+            fixed[i] = findSharedString(string->chars, string->length, string->hash);
+        if (fixed[i] == NULL)
+            fixed[i] = string;
+    }
+
+    valid = valid &&
+            restoreTable(&vm->strings, (const Entry*)(bytes + layout.internTable), header.stringsCapacity,
+                         header.stringsCount, fixed, header.stringCount) &&
+            restoreTable(&vm->globals, (const Entry*)(bytes + layout.globalTable), header.globalsCapacity,
+                         header.globalsCount, fixed, header.stringCount);
+
+    // shared where the snapshot was taken but not here, intern them now
+    for (uint32_t i = header.internedCount; i < header.stringCount && valid; i++) {
+        if (fixed[i] == &strings[i])
+            tableSet(&vm->strings, fixed[i], NIL_VAL);
+    }
+    FREE_ARRAY(ObjString*, fixed, header.stringCount);
+
+    if (!valid) {
+        freeTable(&vm->strings);
+        freeTable(&vm->globals);
+        munmap(mapping, info.st_size);
+        return invalidSnapshot(path, "bad string or table entry");
+    }
+
+    mprotect(mapping, info.st_size, PROT_READ);
+    vm->snapshot = mapping;
+    vm->snapshotSize = info.st_size;
+    return true;
+}
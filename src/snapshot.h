@@ -0,0 +1,49 @@
+#ifndef clox_snapshot_h
+#define clox_snapshot_h
+
+#include "common.h"
+#include "vm.h"
+
+// a vm's heap saved to disk (.loxs): every interned string and the globals,
+// so a prelude runs once and later vms start from its result.
+//
+// the sections are the in-memory structs with pointers replaced by
+// `index + 1` (0 stays NULL), every section 8 bytes aligned:
+//   SnapshotHeader
+//   ObjString[stringCount]    `chars` is an offset into the blob, the
+//                             first internedCount are vm->strings' keys,
+//                             the rest are shared strings the globals use
+//   Entry[stringsCapacity]    vm->strings, slot for slot
+//   Entry[globalsCapacity]    vm->globals, slot for slot
+//   char[blobSize]            the strings' chars, each '\0' terminated
+//
+// restoring maps the file and fixes the pointers up in place, the strings
+// and their chars are used straight from the (then read-only) mapping.
+// tables keep their capacity, so no key is hashed or moved again. a string
+// the vm finds in the shared set (intern.h) is used from there instead
+#define SNAPSHOT_MAGIC "LOXS"
+// bump whenever the layout or the structs above change
+#define SNAPSHOT_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t byteOrder; // IMAGE_BYTE_ORDER
+    uint64_t hash;      // FNV-1a over everything after the header
+    // a snapshot only fits the build that wrote it
+    uint16_t stringSize;
+    uint16_t entrySize;
+    uint32_t stringCount;
+    uint32_t internedCount;
+    uint32_t blobSize;
+    uint32_t stringsCapacity;
+    uint32_t stringsCount;
+    uint32_t globalsCapacity;
+    uint32_t globalsCount;
+} SnapshotHeader;
+
+bool writeSnapshot(VM* vm, const char* path);
+// meant for a fresh vm, whatever it interned before is not interned anymore
+bool loadSnapshot(VM* vm, const char* path);
+
+#endif
@@ -0,0 +1,99 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "source.h"
+
+// pipes, ttys and the like can't be mapped, read them the old way
+static bool readSource(Source* source, int fd) {
+    size_t capacity = 0;
+    size_t length = 0;
+    char* buffer = NULL;
+
+    while (true) {
+        if (capacity - length < 4096) {
+            size_t oldCapacity = capacity;
+            capacity = capacity < 4096 ? 4096 : capacity * 2;
+            buffer = GROW_ARRAY(char, buffer, oldCapacity, capacity);
+        }
+
+        ssize_t bytesRead = read(fd, buffer + length, capacity - length);
+        if (bytesRead < 0) {
+            FREE_ARRAY(char, buffer, capacity);
+            return false;
+        }
+        if (bytesRead == 0)
+            break;
+        length += bytesRead;
+    }
+
+    if (length == 0) {
+        FREE_ARRAY(char, buffer, capacity);
+        source->chars = "";
+        source->length = 0;
+        source->mapped = false;
+        return true;
+    }
+
+    // c: shrink to fit, closeSource() has to know the size for FREE_ARRAY
+    source->chars = GROW_ARRAY(char, buffer, capacity, length + 1);
+    source->length = length;
+    source->mapped = false;
+    return true;
+}
+
+bool openSource(Source* source, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return false;
+    }
+
+    if (!S_ISREG(info.st_mode)) {
+        bool result = readSource(source, fd);
+        close(fd);
+        return result;
+    }
+
+    // mmap doesn't do empty mappings
+    if (info.st_size == 0) {
+        close(fd);
+        source->chars = "";
+        source->length = 0;
+        source->mapped = false;
+        return true;
+    }
+
+    void* chars = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after close
+    close(fd);
+    if (chars == MAP_FAILED)
+        return false;
+
+    // the scanner reads front to back exactly once
+    madvise(chars, info.st_size, MADV_SEQUENTIAL);
+
+    source->chars = chars;
+    source->length = info.st_size;
+    source->mapped = true;
+    return true;
+}
+
+void closeSource(Source* source) {
+    if (source->mapped) {
+        munmap((void*)source->chars, source->length);
+    } else if (source->length > 0) {
+        FREE_ARRAY(char, (char*)source->chars, source->length + 1);
+    }
+
+    source->chars = NULL;
+    source->length = 0;
+    source->mapped = false;
+}
@@ -0,0 +1,17 @@
+#ifndef clox_source_h
+#define clox_source_h
+
+#include "common.h"
+
+// a script's text as loaded from disk. regular files are mmap'ed read-only
+// and scanned in place, there is no '\0' at the end of `chars`
+typedef struct {
+    const char* chars;
+    size_t length;
+    bool mapped; // otherwise `chars` is heap allocated (or empty)
+} Source;
+
+bool openSource(Source* source, const char* path);
+void closeSource(Source* source);
+
+#endif
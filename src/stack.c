@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stack.h"
+
+// the region of the vm running on this thread, if any
+static _Thread_local StackRegion* activeRegion = NULL;
+
+// the handler is process wide, installed once by whichever vm comes first
+static pthread_once_t installOnce = PTHREAD_ONCE_INIT;
+static struct sigaction previousAction;
+static size_t pageBytes = 0;
+
+static size_t pageSize() {
+    return pageBytes;
+}
+
+static size_t roundToPage(size_t bytes) {
+    size_t page = pageSize();
+    return (bytes + page - 1) / page * page;
+}
+
+// not our fault, hand it to whoever was installed before (or the default)
+static void forwardSignal(int signal, siginfo_t* info, void* context) {
+    if (previousAction.sa_flags & SA_SIGINFO) {
+        previousAction.sa_sigaction(signal, info, context);
+        return;
+    }
+    if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN) {
+        previousAction.sa_handler(signal);
+        return;
+    }
+
+    // returning re-runs the faulting instruction, which now crashes as usual
+    sigaction(SIGSEGV, &previousAction, NULL);
+}
+
+static void handleFault(int signal, siginfo_t* info, void* context) {
+    StackRegion* region = activeRegion;
+    char* address = (char*)info->si_addr;
+
+    if (region == NULL || address < (char*)region->base || address >= (char*)region->base + STACK_RESERVE) {
+        forwardSignal(signal, info, context);
+        return;
+    }
+
+    // double the committed part, but never into the last page which stays a guard
+    size_t wanted = (size_t)(address - (char*)region->base) + 1;
+    size_t committed = region->committed * 2;
+    if (committed < wanted)
+        committed = roundToPage(wanted);
+    if (committed > STACK_RESERVE - pageSize())
+        committed = STACK_RESERVE - pageSize();
+
+    if (wanted > committed || !commitStack(region, committed)) {
+        siglongjmp(region->overflow, 1);
+    }
+    // return and the push that faulted runs again
+}
+
+static void installHandler() {
+    pageBytes = (size_t)sysconf(_SC_PAGESIZE);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handleFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previousAction);
+}
+
+bool initStackRegion(StackRegion* region) {
+    pthread_once(&installOnce, installHandler);
+
+    void* base = mmap(NULL, STACK_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        return false;
+
+    region->base = (Value*)base;
+    region->committed = 0;
+    return commitStack(region, STACK_INITIAL_COMMIT);
+}
+
+void freeStackRegion(StackRegion* region) {
+    if (region->base != NULL)
+        munmap(region->base, STACK_RESERVE);
+    region->base = NULL;
+    region->committed = 0;
+}
+
+// make sure at least `bytes` of the stack are usable, returns false if that
+// doesn't fit the reservation
+bool commitStack(StackRegion* region, size_t bytes) {
+    bytes = roundToPage(bytes);
+    if (bytes <= region->committed)
+        return true;
+    if (bytes > STACK_RESERVE - pageSize())
+        return false;
+
+    if (mprotect(region->base, bytes, PROT_READ | PROT_WRITE) != 0)
+        return false;
+    region->committed = bytes;
+    return true;
+}
+
+// faults inside `region` are handled while it is entered
+void enterStackRegion(StackRegion* region) {
+    activeRegion = region;
+}
+
+void leaveStackRegion() {
+    activeRegion = NULL;
+}
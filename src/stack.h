@@ -0,0 +1,32 @@
+#ifndef clox_stack_h
+#define clox_stack_h
+
+#include <setjmp.h>
+
+#include "common.h"
+#include "value.h"
+
+// address space reserved for one vm's value stack. only the used part is
+// backed by memory, the rest is PROT_NONE and works as a guard
+#define STACK_RESERVE ((size_t)64 * 1024 * 1024)
+// committed up front, before any chunk asked for more
+#define STACK_INITIAL_COMMIT ((size_t)64 * 1024)
+
+// the value stack lives in its own mapping. pushing past the committed part
+// faults, and the SIGSEGV handler commits more and lets the push retry. the
+// reservation never moves, so no stack pointer has to be rebased. only
+// running into the end of the reservation is an overflow, the handler
+// then jumps back to `overflow`
+typedef struct {
+    Value* base;
+    size_t committed; // bytes, readable and writable from `base`
+    sigjmp_buf overflow;
+} StackRegion;
+
+bool initStackRegion(StackRegion* region);
+void freeStackRegion(StackRegion* region);
+bool commitStack(StackRegion* region, size_t bytes);
+void enterStackRegion(StackRegion* region);
+void leaveStackRegion();
+
+#endif
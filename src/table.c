@@ -40,6 +40,8 @@ Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
         Entry* entry = &entries[index];
         // !: there's is no case that entry pointer can be NULL
         // so we only need to check the `key` field
+        // !we're comparing string's pointer, not string itself
+        // @see https://craftinginterpreters.com/hash-tables.html#string-interning
         if (entry->key == key) {
             return entry;
         }
@@ -62,14 +64,10 @@ Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
                 // mark the first tombstone
                 if (tombstone == nullptr)
                     tombstone = entry;
+                // and keep probing, the key may sit past it
             }
         }
 
-        // !we're comparing string's pointer, not string itself
-        // @see https://craftinginterpreters.com/hash-tables.html#string-interning
-        if (entry->key == key || entry->key == nullptr) {
-            return entry;
-        }
         index = (index + 1) % capacity;
     }
 }
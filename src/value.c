@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "memory.h"
+#include "number.h"
 #include "object.h"
 #include "value.h"
 
@@ -35,16 +36,44 @@ void printValue(Value value) {
         case VAL_NIL:
             printf("nil");
             break;
-        case VAL_NUMBER:
-            // basically %g is short representation for float number
-            printf("%g", AS_NUMBER(value));
+        case VAL_NUMBER: {
+            // same output as printf("%g"), basically a short representation for float number
+            char buffer[NUMBER_BUFFER_SIZE];
+            int length = formatNumber(AS_NUMBER(value), buffer);
+            fwrite(buffer, sizeof(char), length, stdout);
             break;
+        }
         case VAL_OBJ:
             printObject(value);
             break;
     }
 }
 
+// same as printValue, but into a vm's buffered output
+void writeValue(Output* output, Value value) {
+    switch (value.type) {
+        case VAL_BOOL:
+            if (AS_BOOL(value)) {
+                writeOutput(output, "true", 4);
+            } else {
+                writeOutput(output, "false", 5);
+            }
+            break;
+        case VAL_NIL:
+            writeOutput(output, "nil", 3);
+            break;
+        case VAL_NUMBER: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            int length = formatNumber(AS_NUMBER(value), buffer);
+            writeOutput(output, buffer, length);
+            break;
+        }
+        case VAL_OBJ:
+            writeObject(output, value);
+            break;
+    }
+}
+
 // cant use `memcmp` to do the job, because the padding,
 // https://craftinginterpreters.com/types-of-values.html#two-new-types
 bool valuesEqual(Value a, Value b) {
@@ -2,10 +2,12 @@
 #define clox_value_h
 
 #include "common.h"
+#include "output.h"
 
 // c: empty declaration, solve circular dependencies in c
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
+typedef struct VM VM;
 
 typedef enum {
     VAL_BOOL,
@@ -54,5 +56,6 @@ void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
 void printValue(Value value);
+void writeValue(Output* output, Value value);
 
 #endif
\ No newline at end of file
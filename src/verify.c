@@ -0,0 +1,97 @@
+#include <stdio.h>
+
+#include "object.h"
+#include "verify.h"
+
+// what an instruction does to the value stack
+typedef struct {
+    int operands;     // bytes following the opcode
+    int pops;         // values it needs on the stack
+    int pushes;       // values it leaves there
+    bool stringConst; // the operand is a constant index, that must be a string
+} OpEffect;
+
+// clang-format off
+static const OpEffect effects[] = {
+    [OP_CONSTANT]      = {1, 0, 1, false},
+    [OP_NIL]           = {0, 0, 1, false},
+    [OP_TRUE]          = {0, 0, 1, false},
+    [OP_FALSE]         = {0, 0, 1, false},
+    [OP_POP]           = {0, 1, 0, false},
+    [OP_GET_GLOBAL]    = {1, 0, 1, true},
+    [OP_DEFINE_GLOBAL] = {1, 1, 0, true},
+    [OP_SET_GLOBAL]    = {1, 1, 1, true},
+    [OP_EQUAL]         = {0, 2, 1, false},
+    [OP_GREATER]       = {0, 2, 1, false},
+    [OP_LESS]          = {0, 2, 1, false},
+    [OP_ADD]           = {0, 2, 1, false},
+    [OP_SUBTRACT]      = {0, 2, 1, false},
+    [OP_MULTIPLY]      = {0, 2, 1, false},
+    [OP_DIVIDE]        = {0, 2, 1, false},
+    [OP_NOT]           = {0, 1, 1, false},
+    [OP_NEGATE]        = {0, 1, 1, false},
+    [OP_PRINT]         = {0, 1, 0, false},
+    [OP_RETURN]        = {0, 0, 0, false},
+};
+// clang-format on
+
+#define OPCODE_COUNT (int)(sizeof(effects) / sizeof(effects[0]))
+
+int stackEffect(uint8_t opcode) {
+    return effects[opcode].pushes - effects[opcode].pops;
+}
+
+int instructionLength(uint8_t opcode) {
+    return 1 + effects[opcode].operands;
+}
+
+static bool verifyError(int offset, const char* message) {
+    fprintf(stderr, "Invalid bytecode at %04d: %s.\n", offset, message);
+    return false;
+}
+
+// check a chunk before the vm runs it, the vm does no checks of its own:
+//  - every opcode is known and its operands are inside the chunk
+//  - constant operands index into the constant pool, with a string for globals
+//  - no instruction pops more than the stack holds
+//  - the last instruction is OP_RETURN, so `ip` never runs off the end
+// the code is straight line (there are no jumps yet), so one pass finds the
+// deepest the stack gets, which is kept in `chunk->maxStack`
+bool verifyChunk(Chunk* chunk) {
+    int depth = 0;
+    int maxDepth = 0;
+    int last = -1;
+
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t opcode = chunk->code[offset];
+        if (opcode >= OPCODE_COUNT)
+            return verifyError(offset, "unknown opcode");
+
+        const OpEffect* effect = &effects[opcode];
+        if (offset + effect->operands >= chunk->count)
+            return verifyError(offset, "truncated instruction");
+
+        if (effect->operands > 0) {
+            int index = chunk->code[offset + 1];
+            if (index >= chunk->constants.count)
+                return verifyError(offset, "constant index out of range");
+            if (effect->stringConst && !IS_STRING(chunk->constants.values[index]))
+                return verifyError(offset, "variable name is not a string");
+        }
+
+        if (depth < effect->pops)
+            return verifyError(offset, "stack underflow");
+        depth += effect->pushes - effect->pops;
+        if (depth > maxDepth)
+            maxDepth = depth;
+
+        last = offset;
+        offset += 1 + effect->operands;
+    }
+
+    if (last < 0 || chunk->code[last] != OP_RETURN)
+        return verifyError(last < 0 ? 0 : last, "missing OP_RETURN at the end");
+
+    chunk->maxStack = maxDepth;
+    return true;
+}
@@ -0,0 +1,11 @@
+#ifndef clox_verify_h
+#define clox_verify_h
+
+#include "chunk.h"
+
+bool verifyChunk(Chunk* chunk);
+// for a known opcode, the change in stack depth and the bytes it takes
+int stackEffect(uint8_t opcode);
+int instructionLength(uint8_t opcode);
+
+#endif
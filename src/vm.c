@@ -1,22 +1,32 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "chunk.h"
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "image.h"
+#include "intern.h"
+#include "jit.h"
 #include "memory.h"
 #include "object.h"
+#include "opstats.h"
+#include "profile.h"
+#include "source.h"
+#include "verify.h"
 #include "vm.h"
 
-VM vm;
-
-static void resetStack() {
-    vm.stackTop = vm.stack;
+static void resetStack(VM* vm) {
+    vm->stackTop = vm->stack;
 }
 
-static void runtimeError(const char* format, ...) {
+static void runtimeError(VM* vm, const char* format, ...) {
+    // keep what the script printed so far in front of the error
+    flushOutput(&vm->output);
+
     va_list args;
     //      declare a type to hold rest of arguments
     va_start(args, format);
@@ -25,20 +35,20 @@ static void runtimeError(const char* format, ...) {
     va_end(args);
     fputs("\n", stderr);
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = chunkGetLine(vm.chunk, instruction);
+    size_t instruction = vm->ip - vm->chunk->code - 1;
+    int line = chunkGetLine(vm->chunk, instruction);
     fprintf(stderr, "[line %d] in script\n", line);
 
     // reset value stack, discard all
-    resetStack();
+    resetStack(vm);
 }
 
-static Value peek(int distance) {
-    // this can under flow
-    return *(vm.stackTop - distance - 1);
+static Value peek(VM* vm, int distance) {
+    // can't underflow, chunks are verified before they run
+    return *(vm->stackTop - distance - 1);
 
     // the book using this following line, but I prefer above
-    // return vm.stackTop[-1 - distance];
+    // return vm->stackTop[-1 - distance];
 }
 
 static bool isFalsey(Value value) {
@@ -47,9 +57,9 @@ static bool isFalsey(Value value) {
 
 // string concatenate implementation
 // two strings read from the value stack
-static void concatenate() {
-    ObjString* b = AS_STRING(pop());
-    ObjString* a = AS_STRING(pop());
+static void concatenate(VM* vm) {
+    ObjString* b = AS_STRING(pop(vm));
+    ObjString* a = AS_STRING(pop(vm));
 
     int length = a->length + b->length;
     char* chars = ALLOCATE(char, length + 1);
@@ -57,196 +67,309 @@ static void concatenate() {
     memcpy(chars + a->length, b->chars, b->length);
     chars[length] = '\0';
 
-    ObjString* result = takeString(chars, length);
-    push(OBJ_VAL(result));
-}
-
-void initVM() {
-    resetStack();
-    vm.objects = NULL;
-    initTable(&vm.globals);
-    initTable(&vm.strings);
-}
-
-void freeVM() {
-    // todo: also free `vm.chunk` ?
-    freeObjects();
-    freeTable(&vm.globals);
-    freeTable(&vm.strings);
-}
-
-static InterpretResult run() {
-#define READ_BYTE() (*vm.ip++)
-#define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
-// ?: does this `double` break the abstraction for Value type?
-// I would think so, the better way is to use `Value` for type instead of double
-#define BINDARY_OP(valueType, op)                                                                                      \
-    do {                                                                                                               \
-        if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {                                                              \
-            runtimeError("Operands must be numbers.");                                                                 \
-            return INTERPRET_RUNTIME_ERROR;                                                                            \
-        }                                                                                                              \
-        double b = AS_NUMBER(pop());                                                                                   \
-        double a = AS_NUMBER(pop());                                                                                   \
-        push(valueType(a op b));                                                                                       \
-    } while (false)
-
-    for (;;) {
-#ifdef DEBUG_TRACE_EXECUTION
-        // print constants stack per iteration
-        printf("          ");
-        for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-            printf("[ ");
-            printValue(*slot);
-            printf(" ]");
-        }
-        printf("\n");
-
-        // disassembleInstruction(vm.chunk, (int)(vm.ip - vm.chunk->code)/sizeof(uint8_t));
-        // m:                                                             ^- a divide is wrong
-        // basic unit for pointer is byte. so this is actually right, since sizeof(uint8_t) == 1,
-        // the following line just implicitly imply this
-        disassembleInstruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
-#endif
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT: {
-                Value constant = READ_CONSTANT();
-                push(constant);
-                break;
-            }
-            case OP_NIL: // nil, like object-c or lua
-                push(NIL_VAL);
-                break;
-            case OP_TRUE:
-                push(BOOL_VAL(true));
-                break;
-            case OP_FALSE:
-                push(BOOL_VAL(false));
-                break;
-            case OP_POP:
-                pop();
-                break;
-            case OP_GET_GLOBAL: {
-                ObjString* name = READ_STRING();
-                Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
-                    runtimeError("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                push(value);
-                break;
-            }
-            case OP_DEFINE_GLOBAL: {
-                ObjString* name = READ_STRING();
-                // set global variable with data from top of the stack
-                tableSet(&vm.globals, name, peek(0));
-                // peek first, as when peeking it still has an valid lifetime.
-                pop();
-                break;
-            }
-            case OP_SET_GLOBAL: {
-                ObjString* name = READ_STRING();
-                if (tableSet(&vm.globals, name, peek(0))) {
-                    // if not already existed in the global variable table, then
-                    // it's error to set this variable.
-                    // clox need global variable to be declared first
-                    tableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
-            }
-            case OP_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push(BOOL_VAL(valuesEqual(a, b)));
-                break;
-            }
-            case OP_GREATER:
-                BINDARY_OP(BOOL_VAL, >);
-                break;
-            case OP_LESS:
-                BINDARY_OP(BOOL_VAL, <);
-                break;
-            case OP_ADD: {
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-                    // string add
-                    concatenate();
-                } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-                    // number add
-                    double b = AS_NUMBER(pop());
-                    double a = AS_NUMBER(pop());
-                    push(NUMBER_VAL(a + b));
-                } else {
-                    runtimeError("Operands must be two numbers or two strings.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
-            }
-            case OP_SUBTRACT:
-                BINDARY_OP(NUMBER_VAL, -);
-                break;
-            case OP_MULTIPLY:
-                BINDARY_OP(NUMBER_VAL, *);
-                break;
-            case OP_DIVIDE:
-                BINDARY_OP(NUMBER_VAL, /);
-                break;
-            case OP_NOT:
-                push(BOOL_VAL(isFalsey(pop())));
-                break;
-            case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
-                    runtimeError("Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                push(NUMBER_VAL(-(AS_NUMBER(pop()))));
-                break;
-            case OP_PRINT: {
-                printValue(pop());
-                printf("\n");
-                break;
-            }
-            case OP_RETURN: {
-                // Exit interpreter.
-                return INTERPRET_OK;
-            }
+    ObjString* result = takeString(vm, chars, length);
+    push(vm, OBJ_VAL(result));
+}
+
+// false when the stack can't be reserved, nothing needs freeing then
+bool initVM(VM* vm) {
+    if (!initStackRegion(&vm->stackRegion))
+        return false;
+    vm->stack = vm->stackRegion.base;
+    resetStack(vm);
+    vm->objects = NULL;
+    vm->pretokenize = false;
+    vm->trace = false;
+    vm->disasm = false;
+    vm->opstats = NULL;
+    vm->allocstats = NULL;
+    vm->running = false;
+    vm->jitThreshold = 0;
+    vm->cache = NULL;
+    vm->slice = 0;
+    vm->suspended = false;
+    initChunk(&vm->owned.chunk);
+    vm->owned.mapping = NULL;
+    vm->owned.size = 0;
+    vm->snapshot = NULL;
+    vm->snapshotSize = 0;
+    initOutput(&vm->output, OUTPUT_BUFFER_SIZE);
+    initTable(&vm->globals);
+    initTable(&vm->strings);
+    vm->sharedStrings = sharedStringsFrozen();
+    return true;
+}
+
+void freeVM(VM* vm) {
+    // todo: also free `vm->chunk` ?
+    freeImage(&vm->owned);
+    if (vm->opstats != NULL)
+        freeOpStats(vm->opstats);
+    vm->opstats = NULL;
+    // nothing tracks it outside of a compile or run, see api.c
+    if (vm->allocstats != NULL)
+        freeAllocStats(vm->allocstats);
+    vm->allocstats = NULL;
+    freeOutput(&vm->output);
+    freeStackRegion(&vm->stackRegion);
+    vm->stack = NULL;
+    vm->stackTop = NULL;
+    freeObjects(vm);
+    freeTable(&vm->globals);
+    freeTable(&vm->strings);
+    if (vm->snapshot != NULL)
+        munmap(vm->snapshot, vm->snapshotSize);
+    vm->snapshot = NULL;
+}
+
+// print the stack and the instruction about to run
+static void traceInstruction(VM* vm) {
+    // keep the script's output in line with the trace
+    flushOutput(&vm->output);
+
+    // print constants stack per iteration
+    printf("          ");
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+        printf("[ ");
+        printValue(*slot);
+        printf(" ]");
+    }
+    printf("\n");
+
+    // disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->code)/sizeof(uint8_t));
+    // m:                                                             ^- a divide is wrong
+    // basic unit for pointer is byte. so this is actually right, since sizeof(uint8_t) == 1,
+    // the following line just implicitly imply this
+    disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->code));
+}
+
+// the plain loop, what every run uses unless a debugging option is on or
+// it's time sliced
+#define DISPATCH_NAME run
+#define DISPATCH_HOOK(vm)
+#define DISPATCH_SLICED 0
+#include "dispatch.h"
+
+// the same loop counting down the slice
+#define DISPATCH_NAME runSliced
+#define DISPATCH_HOOK(vm)
+#define DISPATCH_SLICED 1
+#include "dispatch.h"
+
+// instrumented for --trace. the debugging loops don't care about the
+// countdown, so they always have it
+#define DISPATCH_NAME runTraced
+#define DISPATCH_HOOK(vm) traceInstruction(vm)
+#define DISPATCH_SLICED 1
+#include "dispatch.h"
+
+// and instrumented for --opstats
+#define DISPATCH_NAME runCounted
+#define DISPATCH_HOOK(vm) countInstruction(vm->opstats, *vm->ip)
+#define DISPATCH_SLICED 1
+#include "dispatch.h"
+
+// the loop for the vm's debugging options and slice, run() when there are
+// none
+static InterpretResult dispatch(VM* vm) {
+    if (vm->opstats != NULL)
+        return runCounted(vm);
+    if (vm->trace)
+        return runTraced(vm);
+    if (vm->slice > 0)
+        return runSliced(vm);
+    return run(vm);
+}
+
+// the chunk's machine code, when the vm has the jit on and the chunk ran
+// often enough. NULL when it has to be interpreted
+static JitCode* jitFor(VM* vm, Chunk* chunk) {
+    // the debugging loops see every instruction, machine code has none. and
+    // it only sets ip at helper calls, samples would land on stale lines
+    if (vm->jitThreshold == 0 || vm->trace || vm->opstats != NULL || profileRunning())
+        return NULL;
+    // machine code can't yield, so only a chunk that fits in a slice whole
+    if (vm->slice > 0 && (uint64_t)chunk->count > vm->slice)
+        return NULL;
+
+    if (chunk->jit == NULL && chunk->runs >= 0 && ++chunk->runs >= vm->jitThreshold) {
+        chunk->jit = compileJit(chunk);
+        if (chunk->jit == NULL)
+            chunk->runs = -1;
+    }
+    return chunk->jit;
+}
+
+// compile with the vm's settings, `source` doesn't have to be '\0' terminated
+bool compileSource(VM* vm, const char* source, size_t length, Chunk* chunk) {
+    if (!vm->pretokenize)
+        return compile(vm, source, length, chunk);
+
+    TokenStream tokens;
+    initTokenStream(&tokens);
+    tokenize(&tokens, source, length);
+    bool compiled = compileStream(vm, &tokens, chunk);
+    freeTokenStream(&tokens);
+    return compiled;
+}
+
+// run() inside the stack guard, from wherever `ip` is. or `jit`'s machine
+// code first, when there's some and the run starts at the beginning
+static InterpretResult runGuarded(VM* vm, JitCode* jit) {
+    // the SIGSEGV handler jumps back here when the stack runs out
+    if (sigsetjmp(vm->stackRegion.overflow, 1) != 0) {
+        leaveStackRegion();
+        leaveProfile();
+        vm->running = false;
+        if (vm->opstats != NULL)
+            stopOpStats(vm->opstats);
+        runtimeError(vm, "Stack overflow.");
+        vm->suspended = false;
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    enterStackRegion(&vm->stackRegion);
+    enterProfile(vm);
+    vm->running = true;
+    // machine code that gives up leaves `ip` where run() takes over
+    InterpretResult result = jit != NULL && runJit(jit, vm) ? INTERPRET_OK : dispatch(vm);
+    vm->running = false;
+    leaveProfile();
+    leaveStackRegion();
+    if (vm->opstats != NULL)
+        stopOpStats(vm->opstats);
+
+    vm->suspended = result == INTERPRET_YIELD;
+    if (!vm->suspended)
+        freeImage(&vm->owned);
+    return result;
+}
+
+// hand the chunk of a run that just yielded over to the vm. the arrays move,
+// `ip` still points into them
+static void keepSuspended(VM* vm, Image* image) {
+    vm->owned = *image;
+    vm->chunk = &vm->owned.chunk;
+}
+
+// run an already compiled chunk, the chunk stays owned by the caller, and
+// must stay alive as long as the run is suspended.
+// the chunk is verified first (once), so run() can push and pop unchecked
+InterpretResult interpretChunk(VM* vm, Chunk* chunk) {
+    if (chunk->maxStack < 0 && !verifyChunk(chunk))
+        return INTERPRET_COMPILE_ERROR;
+
+    // a new script drops whatever was suspended
+    vm->suspended = false;
+    freeImage(&vm->owned);
+
+    // back what the chunk needs with memory right away, so it never faults.
+    // if it needs more than the reservation, the guard reports the overflow
+    commitStack(&vm->stackRegion, sizeof(Value) * chunk->maxStack);
+    // a new script starts with an empty stack
+    resetStack(vm);
+
+    // build the line index now, the profiler looks lines up from a signal
+    // handler where it can't allocate
+    indexEncoding(&chunk->line_encodings);
+    if (vm->disasm)
+        disassembleChunk(chunk, "code");
+    if (vm->opstats != NULL)
+        resetOpHistory(vm->opstats);
+
+    vm->chunk = chunk;
+    vm->ip = vm->chunk->code;
+    return runGuarded(vm, jitFor(vm, chunk));
+}
+
+// continue a run that yielded, with a fresh slice
+InterpretResult resume(VM* vm) {
+    if (!vm->suspended)
+        return INTERPRET_OK;
+    return runGuarded(vm, NULL);
+}
+
+static InterpretResult interpretCached(VM* vm, const char* source, size_t length) {
+    uint8_t key[SHA256_SIZE];
+    cacheKey(source, length, key);
+
+    Chunk* cached = cacheGet(vm->cache, vm, key);
+    if (cached == NULL) {
+        Chunk chunk;
+        initChunk(&chunk);
+
+        if (!compileSource(vm, source, length, &chunk)) {
+            freeChunk(&chunk);
+            return INTERPRET_COMPILE_ERROR;
         }
+        cached = cachePut(vm->cache, key, &chunk);
     }
-#undef READ_BYTE
-#undef READ_CONSTANT
-#undef READ_STRING
-#undef BINDARY_OP
+
+    return interpretChunk(vm, cached);
 }
 
-InterpretResult interpret(const char* source) {
+InterpretResult interpretSource(VM* vm, const char* source, size_t length) {
+    if (vm->cache != NULL)
+        return interpretCached(vm, source, length);
+
     Chunk chunk;
     initChunk(&chunk);
 
-    if (!compile(source, &chunk)) {
+    if (!compileSource(vm, source, length, &chunk)) {
         freeChunk(&chunk);
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
-
-    InterpretResult result = run();
+    InterpretResult result = interpretChunk(vm, &chunk);
+    if (result == INTERPRET_YIELD) {
+        Image image = {.chunk = chunk, .mapping = NULL, .size = 0};
+        keepSuspended(vm, &image);
+        return result;
+    }
 
     freeChunk(&chunk);
 
     return result;
 }
 
-void push(Value value) {
-    *vm.stackTop = value;
-    vm.stackTop++;
+InterpretResult interpret(VM* vm, const char* source) {
+    return interpretSource(vm, source, strlen(source));
+}
+
+// run a script straight from an mmap'ed file, no copy of the source is made
+InterpretResult interpretFile(VM* vm, const char* path) {
+    Source source;
+    if (!openSource(&source, path))
+        return INTERPRET_IO_ERROR;
+
+    InterpretResult result = interpretSource(vm, source.chars, source.length);
+    closeSource(&source);
+    return result;
+}
+
+// run a precompiled .loxc image, see image.h
+InterpretResult interpretImage(VM* vm, const char* path) {
+    Image image;
+    if (!loadImage(vm, &image, path))
+        return INTERPRET_IO_ERROR;
+
+    InterpretResult result = interpretChunk(vm, &image.chunk);
+    if (result == INTERPRET_YIELD) {
+        keepSuspended(vm, &image);
+        return result;
+    }
+    freeImage(&image);
+    return result;
+}
+
+// no bounds checks in push/pop. verifyChunk() proved the stack never
+// underflows, and overflowing faults on the guard pages, see stack.h
+void push(VM* vm, Value value) {
+    *vm->stackTop = value;
+    vm->stackTop++;
 }
 
-Value pop() {
-    vm.stackTop--;
-    // todo: this can underflow, if not track properly
-    return *vm.stackTop;
+Value pop(VM* vm) {
+    vm->stackTop--;
+    return *vm->stackTop;
 }
\ No newline at end of file
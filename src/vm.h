@@ -1,37 +1,78 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include "allocstats.h"
+#include "cache.h"
 #include "chunk.h"
+#include "opstats.h"
+#include "output.h"
+#include "stack.h"
 #include "table.h"
 #include "value.h"
 
-#define STACK_MAX 256
 
-typedef struct {
+// one interpreter instance. instances share nothing, so several can run
+// side by side, each on its own thread
+struct VM {
     Chunk* chunk;           // program instructions
     uint8_t* ip;            // program instruction pointer
-    Value stack[STACK_MAX]; // static allocated Value stack
-    Value* stackTop;        // Value stack pointer
+    Value* stack;     // Value stack, grows on demand, see stack.h
+    Value* stackTop;  // Value stack pointer
+    StackRegion stackRegion;
     Table globals;
     Table strings;
+    // look strings up in the shared set first, see intern.h
+    bool sharedStrings;
     Obj* objects;
-} VM;
+    // where `print` goes
+    Output output;
+    // tokenize the whole source before compiling it
+    bool pretokenize;
+    // print the stack and every instruction as it runs, picks the
+    // instrumented copy of the dispatch loop, see dispatch.h
+    bool trace;
+    // print each chunk's bytecode before it runs
+    bool disasm;
+    // when set, runs count what they execute in here, see opstats.h
+    OpStats* opstats;
+    // when set, allocations are charged to the line running, see allocstats.h
+    AllocStats* allocstats;
+    // inside run(), `chunk` and `ip` are current
+    bool running;
+    // compile a chunk to machine code on its nth run, 0 for never, see jit.h
+    int jitThreshold;
+    // when set, interpret() reuses chunks compiled from the same source
+    ChunkCache* cache;
+    // instructions a run gets before it yields, 0 for no limit
+    uint64_t slice;
+    // yielded, resume() continues at `ip` with the stack as it was
+    bool suspended;
+    // a suspended run's chunk when it came from source or an image, so it
+    // outlives the interpret call that compiled or loaded it
+    Image owned;
+    // strings restored from a snapshot live in this mapping, see snapshot.h
+    void* snapshot;
+    size_t snapshotSize;
+};
 
 typedef enum {
     INTERPRET_OK,
     INTERPRET_COMPILE_ERROR,
     INTERPRET_RUNTIME_ERROR,
+    INTERPRET_IO_ERROR, // couldn't read the script or image
+    INTERPRET_YIELD,    // ran out of its slice, see resume()
 } InterpretResult;
 
-// todo: why use extern here?
-// object.c depends on this `vm` variable which is declared in vm.c
-// basically export this `vm` variable declared in the c file
-extern VM vm;
-
-void initVM();
-void freeVM();
-InterpretResult interpret(const char* source);
-void push(Value value);
-Value pop();
+bool initVM(VM* vm);
+void freeVM(VM* vm);
+InterpretResult interpret(VM* vm, const char* source);
+InterpretResult interpretSource(VM* vm, const char* source, size_t length);
+InterpretResult interpretFile(VM* vm, const char* path);
+InterpretResult interpretImage(VM* vm, const char* path);
+InterpretResult interpretChunk(VM* vm, Chunk* chunk);
+InterpretResult resume(VM* vm);
+bool compileSource(VM* vm, const char* source, size_t length, Chunk* chunk);
+void push(VM* vm, Value value);
+Value pop(VM* vm);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,187 @@
+// checks parseNumber() against strtod() and formatNumber() against
+// printf("%g"), bit for bit and byte for byte, on generated inputs plus the
+// edge cases the fast paths in number.c have to get right: ties, 2^53,
+// subnormals, the %g notation switch near 1e-5 and 1e6, and literals with
+// more digits than an uint64_t holds.
+//
+// usage:
+//   cmake --build build --target number_test && ./build/bin/number_test [cases]
+//
+// prints every mismatch, exits with 1 if there was one
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+#define DEFAULT_CASES 1000000
+// mismatches printed per check, the count is still complete
+#define MAX_REPORTS 20
+
+static long checked = 0;
+static long failed = 0;
+
+// xorshift64*, the same inputs on every run
+static uint64_t state = 0x9e3779b97f4a7c15u;
+
+static uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1du;
+}
+
+static int below(int bound) {
+    return (int)(next() % (uint64_t)bound);
+}
+
+static void fail(const char* format, ...) {
+    if (failed++ >= MAX_REPORTS)
+        return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static void checkParse(const char* literal) {
+    checked++;
+    double expected = strtod(literal, NULL);
+    double got = parseNumber(literal, (int)strlen(literal));
+    if (memcmp(&expected, &got, sizeof(double)) != 0)
+        fail("parse \"%s\": got %a, strtod gives %a\n", literal, got, expected);
+}
+
+static void checkFormat(double value) {
+    checked++;
+    char expected[64];
+    char got[NUMBER_BUFFER_SIZE];
+    snprintf(expected, sizeof(expected), "%g", value);
+    int length = formatNumber(value, got);
+    if (strcmp(expected, got) != 0 || length != (int)strlen(expected))
+        fail("format %a: got \"%s\" (%d), %%g gives \"%s\"\n", value, got, length, expected);
+}
+
+// the value and its neighbours on both sides
+static void checkFormatAround(double value) {
+    double lower = value;
+    double upper = value;
+    for (int i = 0; i < 4; i++) {
+        lower = nextafter(lower, -INFINITY);
+        upper = nextafter(upper, INFINITY);
+        checkFormat(lower);
+        checkFormat(upper);
+    }
+    checkFormat(value);
+    checkFormat(-value);
+}
+
+// a literal the scanner would match, `[0-9]+(\.[0-9]+)?`
+static void randomLiteral(char* buffer, int integerDigits, int fractionDigits) {
+    int length = 0;
+    for (int i = 0; i < integerDigits; i++)
+        buffer[length++] = (char)('0' + below(10));
+    if (fractionDigits > 0) {
+        buffer[length++] = '.';
+        for (int i = 0; i < fractionDigits; i++)
+            buffer[length++] = (char)('0' + below(10));
+    }
+    buffer[length] = '\0';
+}
+
+static void parseEdgeCases() {
+    static const char* literals[] = {
+        "0", "0.0", "00000", "0.000", "1", "1.0", "0.1", "0.2", "0.3", "0.30000000000000004",
+        // 2^53 and around, 2^53 + 1 is a tie between 2^53 and 2^53 + 2
+        "9007199254740991", "9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995",
+        "9007199254740992.0", "9007199254740992.5", "4503599627370495.5", "4503599627370496.5",
+        // ties right between two doubles
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000033306690738754696212708950042724609375", "0.5000000000000000277555756156289135105907917022705078125",
+        // 19 to 23 digits, around where the mantissa stops fitting
+        "1234567890123456789", "9999999999999999999", "18446744073709551615", "18446744073709551616",
+        "12345678901234567890123", "99999999999999999999999", "10000000000000000000000", "1000000000000000000000.5",
+        "0.1234567890123456789", "0.12345678901234567890123", "1.2345678901234567890123", "123456789012.34567890123",
+        "0.0000000000000000000001", "0.00000000000000000000001", "0.000000000000000000000012345",
+        // powers of ten the fast path divides by
+        "1000000000000000000000", "10000000000000000000000", "100000000000000000000000",
+        // the largest double and past it
+        "179769313486231570814527423731704356798070567525844996598917476803157260780028538760589558632766878171540"
+        "458953514382464234321326889464182768467546703537516986049910576551282076245490090389328944075868508455133"
+        "942304583236903222948165808559332123348274797826204144723168738177180919299881250404026184124858368",
+        "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330"
+        "286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069"
+        "855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792",
+    };
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++)
+        checkParse(literals[i]);
+
+    // subnormals, the smallest one and the smallest normal as plain decimals
+    char buffer[1200];
+    static const char* subnormals[] = {"4940656458412465441765687928682213723651", "2225073858507201136057409796709131975934",
+                                       "2470328229206232720882538", "1"};
+    static const int zeros[] = {323, 307, 323, 324};
+    for (int i = 0; i < 4; i++) {
+        int length = snprintf(buffer, sizeof(buffer), "0.");
+        for (int j = 0; j < zeros[i]; j++)
+            buffer[length++] = '0';
+        snprintf(buffer + length, sizeof(buffer) - length, "%s", subnormals[i]);
+        checkParse(buffer);
+    }
+}
+
+static void formatEdgeCases() {
+    static const double values[] = {
+        0, 1, 0.1, 0.5, 1.5, 2.5, 100000, 999999, 1000000, 9007199254740992.0, 9007199254740993.0,
+        // where %g switches notation
+        1e-5, 0.0001, 0.00009999995, 0.000099999949, 0.00010000005, 999999.5, 999999.4999999, 999999.5000001,
+        999999.49999999994, 1e6, 1e-4,
+        // rounding at the 6th digit
+        1.0000005, 1.0000015, 0.1234565, 123456.5, 123457.5, 100000.5, 12345.65, 1234.565,
+        // far out and tiny
+        1e300, 1e-300, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+    };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        checkFormatAround(values[i]);
+
+    checkFormat(-0.0);
+    checkFormat(INFINITY);
+    checkFormat(-INFINITY);
+    checkFormat(NAN);
+
+    // exact ties at the 6th significant digit, %g rounds those to even
+    for (int k = 100000; k < 101000; k++) {
+        checkFormat(k + 0.5);
+        checkFormat((k + 0.5) / 1024);
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    long cases = argc > 1 ? atol(argv[1]) : DEFAULT_CASES;
+
+    parseEdgeCases();
+    formatEdgeCases();
+
+    char literal[64];
+    for (long i = 0; i < cases; i++) {
+        // short literals are what scripts have, long ones leave the fast path
+        int integerDigits = 1 + (below(4) == 0 ? below(23) : below(7));
+        int fractionDigits = below(3) == 0 ? 0 : 1 + (below(4) == 0 ? below(24) : below(6));
+        randomLiteral(literal, integerDigits, fractionDigits);
+        checkParse(literal);
+
+        // any finite double, then one in the range %g prints in fixed notation
+        uint64_t bits = next();
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        if (isfinite(value))
+            checkFormat(value);
+        checkFormat(strtod(literal, NULL) * pow(10, below(12) - 6));
+    }
+
+    printf("%ld checked, %ld failed\n", checked, failed);
+    return failed == 0 ? 0 : 1;
+}